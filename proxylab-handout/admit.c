@@ -0,0 +1,90 @@
+/* admit
+ * adaptive admission control for cache misses
+ * the number of origin fetches running at the same time is capped by a
+ * limit that follows the origin's health (AIMD): every fetch that
+ * answers in time raises the limit by 1/limit, about one per round of
+ * fetches, and a slow or failed fetch cuts it by ADMIT_BACKOFF, at most
+ * once per ADMIT_MIN_WINDOW_NS so a burst of slow answers counts once
+ *
+ * "in time" compares a fast moving average of the time to the first
+ * response byte with a slow moving average (the baseline), so what
+ * counts as slow adapts to each deployment
+ * a miss over the limit is shed at once instead of tying up a worker,
+ * which keeps workers free to serve cache hits during a brownout
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include "csapp.h"
+#include "admit.h"
+#include "metrics.h"
+
+//=========================================functions
+/* admit_create
+ * returns an admission controller allowing up to max_limit fetches
+ */
+AC *admit_create (unsigned max_limit) {
+    AC *admit = Calloc(1, sizeof(AC));
+    admit->max_limit = max_limit;
+    admit->limit = max_limit;
+    Sem_init(&admit->mutex, 0, 1);
+    metrics_gauge(G_ADMIT_LIMIT, max_limit);
+    return admit;
+}
+
+/* admit_acquire
+ * asks to start a fetch
+ * returns 1 if it may go on, 0 if it must be shed
+ */
+int admit_acquire (AC *admit) {
+    int admitted;
+    unsigned inflight;
+    P(&admit->mutex);
+    admitted = (admit->inflight < (unsigned)admit->limit);
+    if (admitted) {
+        admit->inflight++;
+    }
+    inflight = admit->inflight;
+    V(&admit->mutex);
+    metrics_gauge(G_ADMIT_INFLIGHT, inflight);
+    return admitted;
+}
+
+/* admit_release
+ * ends a fetch admitted by admit_acquire
+ * latency_ns is the time to the first response byte, ignored if the
+ * fetch failed
+ */
+void admit_release (AC *admit, unsigned long latency_ns, int failed) {
+    unsigned long now = metrics_now_ns();
+    P(&admit->mutex);
+    admit->inflight--;
+    if (!failed) {
+        if (admit->baseline == 0) {
+            admit->baseline = admit->latency = latency_ns;
+        }
+        admit->latency += ADMIT_FAST_ALPHA * (latency_ns - admit->latency);
+        admit->baseline += ADMIT_SLOW_ALPHA * (latency_ns - admit->baseline);
+    }
+    if (failed || admit->latency > ADMIT_TOLERANCE * admit->baseline) {
+        if (now - admit->last_decrease > ADMIT_MIN_WINDOW_NS) {
+            admit->limit *= ADMIT_BACKOFF;
+            if (admit->limit < ADMIT_MIN_LIMIT) {
+                admit->limit = ADMIT_MIN_LIMIT;
+            }
+            admit->last_decrease = now;
+        }
+    }
+    else if (admit->limit < admit->max_limit) {
+        admit->limit += 1.0 / admit->limit;
+        if (admit->limit > admit->max_limit) {
+            admit->limit = admit->max_limit;
+        }
+    }
+    unsigned limit = admit->limit, inflight = admit->inflight;
+    V(&admit->mutex);
+    metrics_gauge(G_ADMIT_LIMIT, limit);
+    metrics_gauge(G_ADMIT_INFLIGHT, inflight);
+}
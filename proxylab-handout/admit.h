@@ -0,0 +1,32 @@
+/* This header file contains the interfaces to admission control
+ * of requests that have to go to the origin server
+ */
+#ifndef __ADMIT_H__
+#define __ADMIT_H__
+
+#include "csapp.h"
+
+#define ADMIT_MIN_LIMIT 1
+#define ADMIT_TOLERANCE 2.0     /* slow: over this times the baseline */
+#define ADMIT_BACKOFF 0.75      /* multiplicative decrease */
+#define ADMIT_FAST_ALPHA 0.2    /* weight of a sample in the current latency */
+#define ADMIT_SLOW_ALPHA 0.01   /* weight of a sample in the baseline */
+#define ADMIT_MIN_WINDOW_NS 100000000UL  /* 100 ms between decreases */
+
+typedef struct admit {
+    double limit;               /* fetches allowed at the same time */
+    unsigned max_limit;
+    unsigned inflight;
+    double latency;             /* fast moving average, ns */
+    double baseline;            /* slow moving average, ns */
+    unsigned long last_decrease;
+    sem_t mutex;
+} AC;
+
+AC *admit_create (unsigned max_limit);
+
+int admit_acquire (AC *admit);
+
+void admit_release (AC *admit, unsigned long latency_ns, int failed);
+
+#endif /* __ADMIT_H__ */
@@ -0,0 +1,81 @@
+/* arena
+ * a request takes an arena when it starts, carves its buffers out of it
+ * with arena_alloc, and hands it back when it is done, which frees them
+ * all at once; the buffers used to be arrays on the stack of the worker,
+ * some 100 KB of them, which every thread (and every coroutine, see
+ * coro.c) had to have room for
+ *
+ * idle arenas are kept per thread, so taking one is a list operation
+ * without a lock, and a busy thread keeps reusing the same memory,
+ * which stays in its cache; a coroutine never leaves its thread, so its
+ * arena goes back to the list it came from
+ * an allocation that does not fit is made with malloc, and freed when
+ * the arena is handed back
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include "csapp.h"
+#include "arena.h"
+
+/* this thread's idle arenas */
+static __thread AR *arena_free;
+static __thread unsigned arena_free_cnt;
+
+//=========================================functions
+/* arena_get
+ * returns an empty arena
+ */
+AR *arena_get (void) {
+    AR *ar = arena_free;
+    if (ar) {
+        arena_free = ar->next;
+        arena_free_cnt--;
+        return ar;
+    }
+    ar = Malloc(sizeof(AR));
+    ar->base = Malloc(ARENA_SIZE);
+    ar->used = 0;
+    ar->big = NULL;
+    return ar;
+}
+
+/* arena_alloc
+ * returns n bytes, not cleared, that live until the arena is put back
+ */
+void *arena_alloc (AR *ar, size_t n) {
+    n = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (ar->used + n <= ARENA_SIZE) {
+        void *ptr = ar->base + ar->used;
+        ar->used += n;
+        return ptr;
+    }
+    AGB *big = Malloc(sizeof(AGB) + ARENA_ALIGN + n);
+    big->next = ar->big;
+    ar->big = big;
+    return (char *)big + ARENA_ALIGN;
+}
+
+/* arena_put
+ * frees everything allocated from an arena, and keeps it for the next
+ * request of this thread
+ */
+void arena_put (AR *ar) {
+    while (ar->big) {
+        AGB *next = ar->big->next;
+        Free(ar->big);
+        ar->big = next;
+    }
+    ar->used = 0;
+    if (arena_free_cnt < ARENA_FREE_MAX) {
+        ar->next = arena_free;
+        arena_free = ar;
+        arena_free_cnt++;
+    }
+    else {
+        Free(ar->base);
+        Free(ar);
+    }
+}
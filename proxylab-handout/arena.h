@@ -0,0 +1,31 @@
+/* This header file contains the interfaces to the request arenas,
+ * which hold the buffers of a request instead of the thread's stack
+ */
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include "csapp.h"
+
+#define ARENA_SIZE (128 * 1024) /* holds the buffers of serve_request */
+#define ARENA_ALIGN 16
+#define ARENA_FREE_MAX 64       /* idle arenas kept per thread */
+
+/* an allocation that did not fit in the arena */
+typedef struct arena_big {
+    struct arena_big *next;
+} AGB;
+
+typedef struct arena {
+    struct arena *next;         /* in the thread's free list */
+    char *base;
+    size_t used;
+    AGB *big;
+} AR;
+
+AR *arena_get (void);
+
+void *arena_alloc (AR *ar, size_t n);
+
+void arena_put (AR *ar);
+
+#endif /* __ARENA_H__ */
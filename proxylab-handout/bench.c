@@ -0,0 +1,270 @@
+/* bench
+ * load generator for the proxy, with a stand-in origin server,
+ * so that a benchmark runs offline on a single machine
+ *
+ * the origin serves any path "/<size>/..." with a body of size bytes,
+ * and counts the requests it gets: every request the proxy answers
+ * without reaching the origin is a hit
+ * the requests come from a trace file (-r) or a synthetic Zipf
+ * workload (see trace.c), and are sent by several threads, one request
+ * per connection, each thread waiting for its response before the next
+ *
+ * usage: proxy-bench -p <proxyport> [-t threads] [-n requests]
+ *            [-u objects] [-s zipf] [-m mix] [-S seed]
+ *            [-r trace | -g trace]
+ * -g writes the synthetic workload to a trace file instead of running
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include <stdatomic.h>
+#include "csapp.h"
+#include "hist.h"
+#include "trace.h"
+
+#define BENCH_THREADS 16
+#define BENCH_BODY_CHUNK 65536
+
+static TR *trace;
+static int proxy_port;
+static int origin_port;
+static atomic_uint next_request;
+static atomic_ulong origin_requests;
+static atomic_ulong errors;
+static atomic_ulong bytes_received;
+static HH latency;
+static char origin_body[BENCH_BODY_CHUNK];
+
+//=========================================functions
+static unsigned long bench_now_us (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+/* origin_serve
+ * answers one request with a body of the size given in the path
+ */
+static void origin_serve (int fd) {
+    char line[MAXLINE], method[MAXLINE], path[MAXLINE], hdr[MAXLINE];
+    unsigned size;
+    rio_t rio;
+
+    rio_readinitb(&rio, fd);
+    if (rio_readlineb(&rio, line, MAXLINE) <= 0 ||
+            sscanf(line, "%s %s", method, path) != 2) {
+        return;
+    }
+    while (rio_readlineb(&rio, line, MAXLINE) > 0 && strcmp(line, "\r\n")) {
+        ;
+    }
+    atomic_fetch_add(&origin_requests, 1);
+    if (sscanf(path, "/%u/", &size) != 1) {
+        sprintf(hdr, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+        rio_writen(fd, hdr, strlen(hdr));
+        return;
+    }
+    sprintf(hdr, "HTTP/1.0 200 OK\r\n"
+            "Content-Type: application/octet-stream\r\n"
+            "Content-Length: %u\r\n\r\n", size);
+    if (rio_writen(fd, hdr, strlen(hdr)) < 0) {
+        return;
+    }
+    while (size > 0) {
+        unsigned n = (size < BENCH_BODY_CHUNK) ? size : BENCH_BODY_CHUNK;
+        if (rio_writen(fd, origin_body, n) < 0) {
+            return;
+        }
+        size -= n;
+    }
+}
+
+static void *origin_thread (void *vargp) {
+    int fd = *(int *)vargp;
+    Pthread_detach(pthread_self());
+    Free(vargp);
+    origin_serve(fd);
+    close(fd);
+    return NULL;
+}
+
+/* origin_accept
+ * the stand-in origin server, a thread per connection
+ */
+static void *origin_accept (void *vargp) {
+    int listenfd = *(int *)vargp;
+    pthread_t tid;
+    Pthread_detach(pthread_self());
+    while (1) {
+        int *fdp = Malloc(sizeof(int));
+        if ((*fdp = accept(listenfd, NULL, NULL)) < 0) {
+            Free(fdp);
+            continue;
+        }
+        Pthread_create(&tid, NULL, origin_thread, fdp);
+    }
+    return NULL;
+}
+
+/* bench_request
+ * fetches a trace entry through the proxy
+ * returns 0 if a complete 200 response came back, -1 otherwise
+ */
+static int bench_request (char *uri, unsigned size) {
+    char req[2 * MAXLINE], buf[BENCH_BODY_CHUNK];
+    size_t total = 0;
+    ssize_t n;
+    int fd, ok = 0;
+
+    /* keep the path of a full url */
+    if (!strncmp(uri, "http://", 7) && strchr(uri + 7, '/')) {
+        uri = strchr(uri + 7, '/');
+    }
+    snprintf(req, sizeof(req), "GET http://127.0.0.1:%d/%u%s%s HTTP/1.0\r\n"
+             "Host: 127.0.0.1:%d\r\n\r\n", origin_port, size,
+             (uri[0] == '/') ? "" : "/", uri, origin_port);
+    if ((fd = open_clientfd_r("127.0.0.1", proxy_port)) < 0) {
+        return -1;
+    }
+    if (rio_writen(fd, req, strlen(req)) < 0) {
+        close(fd);
+        return -1;
+    }
+    while ((n = rio_readn(fd, buf, sizeof(buf))) > 0) {
+        if (total == 0) {
+            ok = (n >= 12 && !strncmp(buf + 9, "200", 3));
+        }
+        total += n;
+    }
+    close(fd);
+    atomic_fetch_add(&bytes_received, total);
+    return (ok && n == 0 && total > size) ? 0 : -1;
+}
+
+/* bench_thread
+ * sends the next request of the trace until there is none left
+ */
+static void *bench_thread (void *vargp) {
+    unsigned i;
+    while ((i = atomic_fetch_add(&next_request, 1)) < trace->cnt) {
+        unsigned long start = bench_now_us();
+        if (bench_request(trace->uri[i], trace->size[i]) < 0) {
+            atomic_fetch_add(&errors, 1);
+        }
+        hist_record(&latency, bench_now_us() - start);
+    }
+    return NULL;
+}
+
+static void usage (char *prog) {
+    fprintf(stderr, "usage: %s -p <proxyport> [-t threads] [-n requests] "
+            "[-u objects] [-s zipf] [-m mix] [-S seed] "
+            "[-r trace | -g trace]\n", prog);
+    exit(1);
+}
+
+int main (int argc, char **argv) {
+    unsigned threads = BENCH_THREADS, requests = TRACE_REQUESTS;
+    unsigned objects = TRACE_OBJECTS, seed = 1, i;
+    double zipf = TRACE_ZIPF;
+    char *mix = TRACE_MIX, *trace_in = NULL, *trace_out = NULL;
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    pthread_t *tids, tid;
+    static HS snap;
+    int listenfd, opt;
+
+    while ((opt = getopt(argc, argv, "p:t:n:u:s:m:S:r:g:")) != -1) {
+        switch (opt) {
+        case 'p':
+            proxy_port = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'n':
+            requests = atoi(optarg);
+            break;
+        case 'u':
+            objects = atoi(optarg);
+            break;
+        case 's':
+            zipf = atof(optarg);
+            break;
+        case 'm':
+            mix = optarg;
+            break;
+        case 'S':
+            seed = atoi(optarg);
+            break;
+        case 'r':
+            trace_in = optarg;
+            break;
+        case 'g':
+            trace_out = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (trace_in) {
+        trace = trace_load(trace_in);
+    }
+    else {
+        trace = trace_zipf(requests, objects, zipf, mix, seed);
+    }
+    if (trace == NULL) {
+        fprintf(stderr, "Error: cannot %s trace\n",
+                trace_in ? "read the" : "generate the");
+        exit(1);
+    }
+    if (trace_out) {
+        if (trace_save(trace, trace_out) < 0) {
+            fprintf(stderr, "Error: cannot write %s\n", trace_out);
+            exit(1);
+        }
+        printf("wrote %u requests to %s\n", trace->cnt, trace_out);
+        exit(0);
+    }
+    if (proxy_port <= 0 || threads == 0) {
+        usage(argv[0]);
+    }
+    Signal(SIGPIPE, SIG_IGN);
+
+    /* start the origin on a free loopback port */
+    if ((listenfd = open_local_listenfd(0)) < 0 ||
+            getsockname(listenfd, (SA *)&addr, &addrlen) < 0) {
+        unix_error("origin: open_local_listenfd error");
+    }
+    origin_port = ntohs(addr.sin_port);
+    memset(origin_body, 'x', sizeof(origin_body));
+    Pthread_create(&tid, NULL, origin_accept, &listenfd);
+
+    unsigned long start = bench_now_us();
+    tids = Malloc(threads * sizeof(pthread_t));
+    for (i = 0; i < threads; i++) {
+        Pthread_create(&tids[i], NULL, bench_thread, NULL);
+    }
+    for (i = 0; i < threads; i++) {
+        Pthread_join(tids[i], NULL);
+    }
+    double elapsed = (bench_now_us() - start) / 1e6;
+    Free(tids);
+
+    unsigned long fetched = atomic_load(&origin_requests);
+    hist_add(&snap, &latency);
+    printf("requests    %u (%lu errors) from %u threads in %.2f s\n",
+           trace->cnt, atomic_load(&errors), threads, elapsed);
+    printf("throughput  %.1f req/s, %.1f MB/s\n", trace->cnt / elapsed,
+           atomic_load(&bytes_received) / elapsed / (1 << 20));
+    printf("hit ratio   %.4f (%lu origin fetches)\n",
+           trace->cnt ? 1.0 - (double)fetched / trace->cnt : 0.0, fetched);
+    printf("latency us  p50 %lu  p90 %lu  p99 %lu  p99.9 %lu  max %lu\n",
+           hist_percentile(&snap, 50), hist_percentile(&snap, 90),
+           hist_percentile(&snap, 99), hist_percentile(&snap, 99.9),
+           hist_max(&snap));
+    trace_free(trace);
+    return atomic_load(&errors) ? 1 : 0;
+}
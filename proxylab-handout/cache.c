@@ -2,6 +2,34 @@
  * implemented a LRU cache with linked stach
  * used very very simple P and V operations to implement
  * read-write lock
+ * blocks are also chained in a hash index, so that lookups stay fast
+ * when the cache is sized to gigabytes
+ *
+ * blocks evicted from the memory cache are spilled to the disk cache
+ * (see disk_cache.c) if one is attached to the cache manager
+ *
+ * the whole memory cache can be written to a snapshot file and mapped
+ * back at startup; mapped blocks point into the file, so a restart does
+ * not read the payloads until they are served
+ *
+ * with Cache->compress set, text responses are gzipped when they are
+ * inserted (see compress.c), so the same capacity holds more of them
+ *
+ * with Cache->shm set, the blocks live in a shared memory region that
+ * several proxy processes use together (see shm_cache.c), and the list
+ * and index here stay empty; neither the disk cache nor snapshots are
+ * used then
+ *
+ * blocks are keyed by the normalized request uri (see http_normalize_uri)
+ * a response with a Vary header is only reused for requests that carry
+ * the same values of the listed headers: the block keeps the list and a
+ * hash of those values, and several variants of one key can be cached
+ *
+ * every block knows the length of its headers, so that HEAD requests
+ * and revalidations (see head.c) are answered without the body
+ * a 404 is only kept for CACHE_NEGATIVE_TTL seconds, after which the
+ * next request asks the server again; a 304 is not the object, and is
+ * not cached at all
  *
  * for more information, please refer to the header section in proxy.c
  */
@@ -12,48 +40,299 @@
 
 #include "csapp.h"
 #include "cache.h"
+#include "disk_cache.h"
+#include "shm_cache.h"
+#include "compress.h"
+#include "http.h"
+#include "metrics.h"
+#include "log.h"
 
 //=========================================functions
 /* cache_create_new_cache :
- * creates a new cache manager and return it
+ * creates a new cache manager holding at most max_cache_size bytes,
+ * in objects of at most max_object_size bytes, and return it
  */
-CM *cache_create_new_cache () {
+CM *cache_create_new_cache (size_t max_cache_size, size_t max_object_size) {
     CM *Cache = Malloc (sizeof(CM));
     CB *addi_header = (CB *)malloc(sizeof(CB));
     Cache->head = addi_header;
     Cache->head->next = NULL;
+    Cache->tail = NULL;
+    Cache->bucket_cnt = CACHE_MIN_BUCKETS;
+    while (Cache->bucket_cnt * CACHE_BUCKET_BYTES < max_cache_size) {
+        Cache->bucket_cnt <<= 1;
+    }
+    Cache->buckets = Calloc(Cache->bucket_cnt, sizeof(CB *));
+    Cache->max_cache_size = max_cache_size;
+    Cache->max_object_size = max_object_size;
     Cache->cache_size = 0;
     Cache->block_cnt = 0;
+    Cache->compress = 0;
+    Cache->policy = CACHE_LRU;
+    Cache->disk = NULL;
+    Cache->shm = NULL;
     sem_init(&Cache->mutex, 0, 1);
     return Cache;
 }
 
+/* names of the eviction policies, indexed by CACHE_LRU ... */
+static const char *cache_policy_names[] = { "lru", "fifo", NULL };
+
+/* cache_parse_policy
+ * returns the policy called name, or -1 if there is none
+ */
+int cache_parse_policy (char *name) {
+    int i;
+    for (i = 0; cache_policy_names[i]; i++) {
+        if (!strcasecmp(name, cache_policy_names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *cache_policy_name (int policy) {
+    return cache_policy_names[policy];
+}
+
+/* cache_parse_size
+ * converts a size such as 4096, 64K, 512M or 2G into bytes
+ * returns 0 if the string is not a valid size
+ */
+size_t cache_parse_size (char *str) {
+    char *end;
+    unsigned long long size = strtoull(str, &end, 10);
+    switch (*end) {
+    case 'G': case 'g':
+        size <<= 10;
+        /* fall through */
+    case 'M': case 'm':
+        size <<= 10;
+        /* fall through */
+    case 'K': case 'k':
+        size <<= 10;
+        end++;
+    }
+    return (*end == '\0') ? size : 0;
+}
+
+/* cache_lock
+ * takes Cache->mutex; when it is contended, the time spent
+ * waiting is added to the lock wait metrics
+ */
+static void cache_lock (CM *Cache) {
+    if (sem_trywait(&Cache->mutex) == 0) {
+        return;
+    }
+    unsigned long start = metrics_now_ns();
+    P(&Cache->mutex);
+    metrics_add(M_LOCK_WAITS, 1);
+    metrics_add(M_LOCK_WAIT_NS, metrics_now_ns() - start);
+}
+
+/* cache_hash
+ * FNV-1a hash of a key string, used to index blocks
+ */
+unsigned long cache_hash (const char *key) {
+    return cache_hash_continue(CACHE_HASH_INIT, key);
+}
+
+/* cache_hash_continue
+ * adds a string to an FNV-1a hash, to hash several strings as one
+ */
+unsigned long cache_hash_continue (unsigned long hash, const char *key) {
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+/* cache_vary_hash
+ * hashes the values that the headers listed in vary
+ * (such as "accept-language,cookie") have in the request headers
+ */
+unsigned long cache_vary_hash (const char *vary, char *req_hdrs) {
+    char name[MAXLINE], value[MAXLINE];
+    unsigned long hash = CACHE_HASH_INIT;
+    size_t req_len = req_hdrs ? strlen(req_hdrs) : 0;
+
+    while (*vary) {
+        size_t len = strcspn(vary, ",");
+        if (len >= MAXLINE) {
+            len = MAXLINE - 1;
+        }
+        memcpy(name, vary, len);
+        name[len] = '\0';
+        vary += len + (vary[len] == ',');
+        if (!http_header_value(req_hdrs, req_len, name, value, MAXLINE)) {
+            value[0] = '\0';
+        }
+        hash = cache_hash_continue(hash, name);
+        hash = cache_hash_continue(hash, "=");
+        hash = cache_hash_continue(hash, value);
+        hash = cache_hash_continue(hash, "\n");
+    }
+    return hash;
+}
+
+/* cache_expired
+ * checks if a block expiring at expires (0 if never) is past it
+ */
+int cache_expired (long expires) {
+    return expires && expires <= time(NULL);
+}
+
+/* cache_response_vary
+ * copies the Vary header of a response into vary, lowercased and
+ * without spaces; vary is left empty if the response has none
+ * returns -1 if the response varies on everything (Vary: *)
+ */
+int cache_response_vary (char *data, unsigned size, char *vary) {
+    char value[MAXLINE];
+    size_t hdr_size = http_header_end(data, size);
+    int n = 0;
+    char *ptr;
+
+    vary[0] = '\0';
+    if (!http_header_value(data, hdr_size, "Vary", value, MAXLINE)) {
+        return 0;
+    }
+    for (ptr = value; *ptr; ptr++) {
+        if (*ptr == '*') {
+            return -1;
+        }
+        if (!isspace((unsigned char)*ptr)) {
+            vary[n++] = tolower((unsigned char)*ptr);
+        }
+    }
+    vary[n] = '\0';
+    return 0;
+}
+
 /* cache_create_new_block
  * given the id, data and size, create a new block and returns it
  */
 CB *cache_create_new_block(char *id, char *data, unsigned size) {
-    printf("cache_create new block\n");
+    log_debug("cache_create new block\n");
     CB *temp = (CB *)malloc(sizeof(CB));
     temp->id = (char *)malloc(strlen(id) + 1);
     strcpy(temp->id, id);
+    temp->key_hash = cache_hash(id);
+    temp->vary = NULL;
+    temp->vary_hash = 0;
     temp->data = (char *)malloc(size);
     memcpy(temp->data, data, size);
     temp->size = size;
     temp->prev = NULL;
     temp->next = NULL;
+    temp->hnext = NULL;
+    temp->refcnt = 0;
+    temp->evicted = 0;
+    temp->mapped = 0;
+    temp->shm_off = 0;
+    temp->expires = 0;
+    temp->hdr_size = http_header_end(data, size);
+    temp->encoding = CB_IDENTITY;
+    temp->body_size = 0;
+    temp->raw_size = 0;
+    temp->gzip_hdr_size = 0;
     return temp;
 }
 
+/* cache_free_block
+ * destroys a block and everything it owns
+ */
+void cache_free_block (CB *blk) {
+    if (!blk->mapped) {
+        Free(blk->id);
+        Free(blk->data);
+        if (blk->vary) {
+            Free(blk->vary);
+        }
+    }
+    Free(blk);
+}
+
+/* cache_destroy
+ * frees a cache and all its blocks
+ * no other thread may be using the cache
+ */
+void cache_destroy (CM *Cache) {
+    CB *ptr = Cache->head->next;
+    while (ptr) {
+        CB *next = ptr->next;
+        cache_free_block(ptr);
+        ptr = next;
+    }
+    free(Cache->head);
+    Free(Cache->buckets);
+    if (Cache->shm) {
+        shm_cache_close(Cache->shm);
+    }
+    sem_destroy(&Cache->mutex);
+    Free(Cache);
+}
+
+/* cache_bucket
+ * returns the hash chain of a key hash
+ */
+CB **cache_bucket (CM *Cache, unsigned long key_hash) {
+    return &Cache->buckets[key_hash & (Cache->bucket_cnt - 1)];
+}
+
+/* cache_lookup
+ * returns the block cached for key that suits a request with
+ * the headers req_hdrs, or NULL; expired blocks are left for
+ * eviction, or for the next response of the key to replace
+ * the caller must hold Cache->mutex
+ */
+CB *cache_lookup (CM *Cache, char *key, char *req_hdrs) {
+    unsigned long key_hash = cache_hash(key);
+    CB *ptr = *cache_bucket(Cache, key_hash);
+    while (ptr) {
+        if (ptr->key_hash == key_hash && !strcmp(key, ptr->id) &&
+                !cache_expired(ptr->expires) &&
+                (ptr->vary == NULL ||
+                 ptr->vary_hash == cache_vary_hash(ptr->vary, req_hdrs))) {
+            return ptr;
+        }
+        ptr = ptr->hnext;
+    }
+    return NULL;
+}
+
+/* cache_index_add, cache_index_remove
+ * add a block to / remove a block from the hash index
+ * the caller must hold Cache->mutex
+ */
+void cache_index_add (CM *Cache, CB *blk) {
+    CB **bucket = cache_bucket(Cache, blk->key_hash);
+    blk->hnext = *bucket;
+    *bucket = blk;
+}
+
+void cache_index_remove (CM *Cache, CB *blk) {
+    CB **pp = cache_bucket(Cache, blk->key_hash);
+    while (*pp && *pp != blk) {
+        pp = &(*pp)->hnext;
+    }
+    if (*pp) {
+        *pp = blk->hnext;
+    }
+}
+
 /* cache_insert_after_head
  * given a cache block, insert it after the additional header
  * This functions is used to insert new blocks and update old blocks
  */
 void cache_insert_after_head (CM *Cache, CB *blk) {
-    printf("cache_insert after head\n");
+    log_debug("cache_insert after head\n");
     if (Cache->head->next == NULL) {
         Cache->head->next = blk;
         blk->prev = Cache->head;
         blk->next = NULL;
+        Cache->tail = blk;
     }
     else {
         blk->next = Cache->head->next;
@@ -63,7 +342,7 @@ void cache_insert_after_head (CM *Cache, CB *blk) {
     }
     Cache->cache_size += blk->size;
     Cache->block_cnt++;
-    printf("insert_after_head...done!\n");
+    log_debug("insert_after_head...done!\n");
 }
 
 /* cache_detach_from_list
@@ -73,10 +352,11 @@ void cache_insert_after_head (CM *Cache, CB *blk) {
  * This function is used with cacue_insert_after_head
  * to implement cache_move_to_head*/
 void cache_detach_from_list (CM *Cache, CB *blk) {
-    printf("cache_detach\n");
+    log_debug("cache_detach\n");
     if (blk->next == NULL) {
         CB *temp = blk->prev;
         temp->next = NULL;
+        Cache->tail = (temp == Cache->head) ? NULL : temp;
     }
     else {
         CB *temp = blk->prev;
@@ -89,81 +369,370 @@ void cache_detach_from_list (CM *Cache, CB *blk) {
 /* cache_move_to_head
  * moves a cache block to the head
  * meaning the cache block is recently used
+ * the caller must hold Cache->mutex
  */
 void cache_move_to_head (CM *Cache, CB *blk) {
-    printf("cache_movetohead\n");
-    P(&Cache->mutex);
+    log_debug("cache_movetohead\n");
     cache_detach_from_list(Cache, blk);
     cache_insert_after_head(Cache, blk);
-    V(&Cache->mutex);
 }
 
 /* evict nodes at the end of the list
- * to control the cache's size within MAX_CACHE_SIZE
+ * to control the cache's size within max_cache_size
+ * the caller must hold Cache->mutex; the evicted blocks are chained
+ * through their next pointers and returned, so that they can be
+ * spilled to disk after the mutex is released
  */
-void cache_evict (CM *Cache, int expected_size) {
-    printf("cache_evict\n");
-    P(&Cache->mutex);
-    while (Cache->cache_size > expected_size) {
-        CB *end = Cache->head;
-        while (end->next != NULL) {
-            end = end->next;
+CB *cache_evict (CM *Cache, size_t expected_size) {
+    log_debug("cache_evict\n");
+    CB *victims = NULL;
+    while (Cache->cache_size > expected_size && Cache->tail != NULL) {
+        CB *end = Cache->tail;
+        cache_detach_from_list(Cache, end);
+        cache_index_remove(Cache, end);
+        end->evicted = 1;
+        end->refcnt++;  /* held by the spiller until cache_spill is done */
+        end->next = victims;
+        victims = end;
+        metrics_add(M_EVICTIONS, 1);
+    }
+    return victims;
+}
+
+/* cache_spill
+ * writes evicted blocks to the disk cache (if any), then drops them
+ * the disk cache only holds plain responses, so compressed blocks
+ * are expanded first
+ */
+void cache_spill (CM *Cache, CB *victims) {
+    while (victims) {
+        CB *next = victims->next;
+        if (victims->vary || victims->expires) {
+            /* the disk cache has no notion of variants, nor of expiry */
+        }
+        else if (Cache->disk && victims->encoding == CB_IDENTITY) {
+            disk_cache_put(Cache->disk, victims->id,
+                           victims->data, victims->size);
+        }
+        else if (Cache->disk) {
+            unsigned raw_size;
+            char *raw = compress_expand(victims, &raw_size);
+            if (raw) {
+                disk_cache_put(Cache->disk, victims->id, raw, raw_size);
+                Free(raw);
+            }
         }
-        CB *end_prev = end->prev;
-        end_prev->next = NULL;
-        Cache->cache_size -= end->size;
-        Cache->block_cnt --;
-        Free(end);
+        cache_release(Cache, victims);
+        victims = next;
     }
-    V(&Cache->mutex);
-    return;
 }
+
 /* cache_check:
- * checks if an uri has been cached
+ * checks if a key has been cached for a request with headers req_hdrs
  * returns 1 is cached
  * returns 0 if not cached
  */
-int cache_check (CM *Cache, char *uri) {
-    printf("cache_check\n");
-    CB *ptr = Cache->head->next;
-    while (ptr) {
-        if (!strcmp(uri, ptr->id)) {
-            return 1;
-        }
-        ptr = ptr->next;
+int cache_check (CM *Cache, char *key, char *req_hdrs) {
+    log_debug("cache_check\n");
+    if (Cache->shm) {
+        return shm_cache_check(Cache->shm, key, req_hdrs);
     }
-    return 0;
+    cache_lock(Cache);
+    int cached = (cache_lookup(Cache, key, req_hdrs) != NULL);
+    V(&Cache->mutex);
+    return cached;
 }
 
 /* cache_get
- * given an uri, fetch the block
- * this function is usually used with cache_check
+ * given a key and the request headers (as sent to the server),
+ * fetch the block and, under CACHE_LRU, mark it recently used
+ * returns NULL on a miss; a returned block stays valid until
+ * it is handed back with cache_release
  */
-CB *cache_get (CM *Cache, char *uri) {
-    printf("cache_get\n");
-    CB *ptr = Cache->head->next;
-    while (ptr) {
-        if (!strcmp(uri, ptr->id)) {
+CB *cache_get (CM *Cache, char *key, char *req_hdrs) {
+    log_debug("cache_get\n");
+    if (Cache->shm) {
+        return shm_cache_get(Cache->shm, key, req_hdrs);
+    }
+    cache_lock(Cache);
+    CB *ptr = cache_lookup(Cache, key, req_hdrs);
+    if (ptr) {
+        if (Cache->policy == CACHE_LRU) {
             cache_move_to_head(Cache, ptr);
-            return ptr;
         }
-        ptr = ptr->next;
+        ptr->refcnt++;
     }
-    return NULL;
+    V(&Cache->mutex);
+    return ptr;
+}
+
+/* cache_release
+ * drops a reference taken by cache_get
+ * an evicted block is destroyed by whoever drops the last reference
+ */
+void cache_release (CM *Cache, CB *blk) {
+    int destroy;
+    if (blk->shm_off) {
+        shm_cache_release(Cache->shm, blk);
+        return;
+    }
+    cache_lock(Cache);
+    blk->refcnt--;
+    destroy = (blk->evicted && blk->refcnt == 0);
+    V(&Cache->mutex);
+    if (destroy) {
+        cache_free_block(blk);
+    }
+}
+
+/* cache_same_vary
+ * checks if two blocks vary on the same headers
+ */
+static int cache_same_vary (CB *a, CB *b) {
+    if (a->vary == NULL || b->vary == NULL) {
+        return a->vary == b->vary;
+    }
+    return !strcmp(a->vary, b->vary);
+}
+
+/* cache_add_block
+ * makes a new block visible, replacing older blocks of the same key:
+ * the same variant, and variants that vary on other headers
+ * the replaced blocks go to the victims list for cache_spill
+ * the caller must hold Cache->mutex
+ */
+CB *cache_add_block (CM *Cache, CB *blk, CB *victims) {
+    CB *old = *cache_bucket(Cache, blk->key_hash);
+    while (old) {
+        CB *hnext = old->hnext;
+        if (old->key_hash == blk->key_hash && !strcmp(old->id, blk->id) &&
+                (!cache_same_vary(old, blk) ||
+                 old->vary_hash == blk->vary_hash)) {
+            cache_detach_from_list(Cache, old);
+            cache_index_remove(Cache, old);
+            old->evicted = 1;
+            old->refcnt++;
+            old->next = victims;
+            victims = old;
+        }
+        old = hnext;
+    }
+    cache_insert_after_head(Cache, blk);
+    cache_index_add(Cache, blk);
+    return victims;
 }
+
 /* cache_insert:
- * given uri, data and size, create a new block and insert it
+ * given key, data and size, create a new block and insert it
  * after the head
+ * req_hdrs are the request headers the server answered, and pick the
+ * variant if the response has a Vary header
  */
-void cache_insert (CM *Cache, char *uri, char *data, unsigned size) {
-    printf("inserting cache\n");
-    P(&Cache->mutex);
-    if (size > MAX_OBJECT_SIZE) return;
-    if (size + Cache->cache_size > MAX_CACHE_SIZE) {
-        int expected_size = MAX_CACHE_SIZE - size;
-        cache_evict(Cache, expected_size);
+void cache_insert (CM *Cache, char *key, char *req_hdrs,
+                   char *data, unsigned size) {
+    char vary[MAXLINE];
+    log_debug("inserting cache\n");
+    if (size > Cache->max_object_size || size > Cache->max_cache_size) return;
+    if (cache_response_vary(data, size, vary) < 0) return;
+    int status = http_status(data, http_header_end(data, size));
+    if (status == 304) return;
+    CB *new_block = cache_create_new_block(key, data, size);
+    CB *victims = NULL;
+    if (status == 404) {
+        new_block->expires = time(NULL) + CACHE_NEGATIVE_TTL;
+    }
+    if (vary[0]) {
+        new_block->vary = Malloc(strlen(vary) + 1);
+        strcpy(new_block->vary, vary);
+        new_block->vary_hash = cache_vary_hash(vary, req_hdrs);
+    }
+    if (Cache->compress) {
+        compress_block(new_block);
+        size = new_block->size;
+    }
+    if (Cache->shm) {
+        /* the region keeps a copy of its own */
+        shm_cache_put(Cache->shm, new_block);
+        cache_free_block(new_block);
+        return;
+    }
+    cache_lock(Cache);
+    if (size + Cache->cache_size > Cache->max_cache_size) {
+        size_t expected_size = Cache->max_cache_size - size;
+        victims = cache_evict(Cache, expected_size);
+    }
+    victims = cache_add_block(Cache, new_block, victims);
+    V(&Cache->mutex);
+    cache_spill(Cache, victims);
+}
+
+/* cache_snapshot_save:
+ * writes every block to a snapshot file at path
+ * the blocks are pinned while they are written, so the cache keeps
+ * serving; the file is written aside and renamed into place, which
+ * leaves a mapping of the previous snapshot intact
+ * returns 0 on success, -1 on error
+ */
+int cache_snapshot_save (CM *Cache, char *path) {
+    char tmp_path[MAXLINE];
+    CSH hdr;
+    CB **blocks;
+    CSE *index;
+    unsigned cnt = 0, i;
+    unsigned long off;
+    int fd, rc = 0;
+
+    cache_lock(Cache);
+    blocks = Malloc((Cache->block_cnt + 1) * sizeof(CB *));
+    CB *ptr = Cache->head->next;
+    while (ptr) {
+        ptr->refcnt++;
+        blocks[cnt++] = ptr;
+        ptr = ptr->next;
+    }
+    V(&Cache->mutex);
+
+    index = Malloc((cnt + 1) * sizeof(CSE));
+    off = sizeof(CSH) + cnt * sizeof(CSE);
+    for (i = 0; i < cnt; i++) {
+        index[i].id_len = strlen(blocks[i]->id);
+        index[i].size = blocks[i]->size;
+        index[i].vary_len = blocks[i]->vary ? strlen(blocks[i]->vary) : 0;
+        index[i].vary_hash = blocks[i]->vary_hash;
+        index[i].expires = blocks[i]->expires;
+        index[i].encoding = blocks[i]->encoding;
+        index[i].hdr_size = blocks[i]->hdr_size;
+        index[i].body_size = blocks[i]->body_size;
+        index[i].raw_size = blocks[i]->raw_size;
+        index[i].gzip_hdr_size = blocks[i]->gzip_hdr_size;
+        index[i].id_off = off;
+        index[i].data_off = off + index[i].id_len + 1;
+        index[i].vary_off = index[i].data_off + index[i].size;
+        off = index[i].vary_off + index[i].vary_len + 1;
+    }
+    hdr.magic = CACHE_SNAPSHOT_MAGIC;
+    hdr.version = CACHE_SNAPSHOT_VERSION;
+    hdr.block_cnt = cnt;
+    hdr.reserved = 0;
+
+    snprintf(tmp_path, MAXLINE, "%s.tmp", path);
+    if ((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC,
+                   S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) < 0) {
+        rc = -1;
+    }
+    else {
+        if (rio_writen(fd, &hdr, sizeof(CSH)) < 0 ||
+                rio_writen(fd, index, cnt * sizeof(CSE)) < 0) {
+            rc = -1;
+        }
+        for (i = 0; i < cnt && rc == 0; i++) {
+            if (rio_writen(fd, blocks[i]->id, index[i].id_len + 1) < 0 ||
+                    rio_writen(fd, blocks[i]->data, blocks[i]->size) < 0 ||
+                    rio_writen(fd, blocks[i]->vary ? blocks[i]->vary : "",
+                               index[i].vary_len + 1) < 0) {
+                rc = -1;
+            }
+        }
+        if (close(fd) < 0 || rc < 0 || rename(tmp_path, path) < 0) {
+            unlink(tmp_path);
+            rc = -1;
+        }
+    }
+
+    for (i = 0; i < cnt; i++) {
+        cache_release(Cache, blocks[i]);
+    }
+    Free(index);
+    Free(blocks);
+    log_info("cache snapshot: saved %u blocks to %s\n", cnt, path);
+    return rc;
+}
+
+/* cache_snapshot_load:
+ * maps a snapshot file and adds its blocks to the cache
+ * only the index is read; ids and data are used in place, and the
+ * mapping is kept for the lifetime of the process
+ * returns the number of blocks loaded, or -1 on error
+ */
+int cache_snapshot_load (CM *Cache, char *path) {
+    struct stat st;
+    char *map;
+    CSH *hdr;
+    CSE *index;
+    int fd, loaded = 0;
+    unsigned i;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(CSH)) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    hdr = (CSH *)map;
+    index = (CSE *)(map + sizeof(CSH));
+    if (hdr->magic != CACHE_SNAPSHOT_MAGIC ||
+            hdr->version != CACHE_SNAPSHOT_VERSION ||
+            sizeof(CSH) + (unsigned long)hdr->block_cnt * sizeof(CSE)
+                > st.st_size) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    /* keep the most recently used blocks that fit in the cache */
+    size_t fit_size = 0;
+    unsigned fit_cnt = 0;
+    while (fit_cnt < hdr->block_cnt &&
+           fit_size + index[fit_cnt].size <= Cache->max_cache_size) {
+        fit_size += index[fit_cnt++].size;
+    }
+
+    /* insert from the least recently used, so the order is kept */
+    cache_lock(Cache);
+    for (i = fit_cnt; i-- > 0; ) {
+        CSE *e = &index[i];
+        if (e->id_off + e->id_len >= st.st_size ||
+                map[e->id_off + e->id_len] != '\0' ||
+                e->data_off + e->size > st.st_size ||
+                e->vary_off + e->vary_len >= st.st_size ||
+                map[e->vary_off + e->vary_len] != '\0' ||
+                e->hdr_size > e->size || cache_expired(e->expires) ||
+                (e->encoding == CB_GZIP && (unsigned long)e->hdr_size +
+                    e->body_size + e->gzip_hdr_size != e->size) ||
+                e->size > Cache->max_object_size ||
+                Cache->cache_size + e->size > Cache->max_cache_size) {
+            continue;
+        }
+        CB *blk = (CB *)Malloc(sizeof(CB));
+        blk->id = map + e->id_off;
+        blk->key_hash = cache_hash(blk->id);
+        blk->vary = e->vary_len ? map + e->vary_off : NULL;
+        blk->vary_hash = e->vary_hash;
+        blk->data = map + e->data_off;
+        blk->size = e->size;
+        blk->prev = NULL;
+        blk->next = NULL;
+        blk->hnext = NULL;
+        blk->refcnt = 0;
+        blk->evicted = 0;
+        blk->mapped = 1;
+        blk->shm_off = 0;
+        blk->expires = e->expires;
+        blk->encoding = (e->encoding == CB_GZIP) ? CB_GZIP : CB_IDENTITY;
+        blk->hdr_size = e->hdr_size;
+        blk->body_size = e->body_size;
+        blk->raw_size = e->raw_size;
+        blk->gzip_hdr_size = e->gzip_hdr_size;
+        cache_insert_after_head(Cache, blk);
+        cache_index_add(Cache, blk);
+        loaded++;
     }
-    CB *new_block = cache_create_new_block(uri, data, size);
-    cache_insert_after_head(Cache, new_block);
     V(&Cache->mutex);
+    log_info("cache snapshot: loaded %d blocks from %s\n", loaded, path);
+    return loaded;
 }
@@ -1,29 +1,127 @@
 /* This header file contains the essential interfaces to proxy.c*/
+#ifndef __CACHE_H__
+#define __CACHE_H__
 
+#include <limits.h>
 #include "csapp.h"
 
+/* default limits, both can be changed on the command line */
 #define MAX_CACHE_SIZE 1049000
 #define MAX_OBJECT_SIZE 102400
+#define CACHE_OBJECT_LIMIT UINT_MAX /* block sizes are unsigned */
+#define CACHE_MIN_BUCKETS 1024
+#define CACHE_BUCKET_BYTES 8192 /* one hash bucket per this many bytes */
+#define CACHE_SNAPSHOT_MAGIC 0x50585353 /* "PXSS" */
+#define CACHE_SNAPSHOT_VERSION 4
+#define CACHE_HASH_INIT 14695981039346656037UL
+#define CACHE_NEGATIVE_TTL 10   /* seconds a 404 is cached for */
+
+/* how the body of a block is stored, see compress.c */
+#define CB_IDENTITY 0
+#define CB_GZIP 1
+
+/* eviction policies, blocks are always evicted from the tail */
+#define CACHE_LRU 0     /* a hit moves the block to the head */
+#define CACHE_FIFO 1    /* blocks stay in insertion order */
+
+struct disk_cache;
+struct shm_cache;
 
 typedef struct cache_manager {
     struct cache_block *head;
-    unsigned cache_size;
+    struct cache_block *tail;
+    struct cache_block **buckets;   /* hash index over the keys */
+    unsigned long bucket_cnt;       /* a power of 2 */
+    size_t max_cache_size;
+    size_t max_object_size;
+    size_t cache_size;
     unsigned block_cnt;
+    int compress;               /* gzip text bodies when they are cached */
+    int policy;                 /* CACHE_LRU or CACHE_FIFO */
+    struct disk_cache *disk;    /* second tier, NULL if disabled */
+    struct shm_cache *shm;      /* shared with other processes, or NULL */
     sem_t mutex;
 } CM;
 
 typedef struct cache_block {
     struct cache_block *next;
     struct cache_block *prev;
-    char *id;
+    struct cache_block *hnext;  /* next block in the hash chain */
+    char *id;                   /* normalized uri, see http_normalize_uri */
+    unsigned long key_hash;     /* cache_hash(id) */
+    char *vary;                 /* headers listed in Vary, or NULL */
+    unsigned long vary_hash;    /* cache_vary_hash of the request */
     unsigned size;
     char *data;
+    int refcnt;                 /* readers currently using the block */
+    int evicted;                /* detached, freed when refcnt drops to 0 */
+    int mapped;                 /* id and data live in a snapshot mapping,
+                                   or in the shared cache */
+    unsigned long shm_off;      /* its entry in the shared cache, or 0 */
+    long expires;               /* time it stops being served, or 0 */
+    unsigned hdr_size;          /* length of the original headers */
+    int encoding;               /* CB_IDENTITY, or CB_GZIP with: */
+    unsigned body_size;         /*   length of the gzip body */
+    unsigned raw_size;          /*   length of the body before gzip */
+    unsigned gzip_hdr_size;     /*   length of the headers for gzip */
 } CB;
 
-CM *cache_create_new_cache ();
+/* a snapshot file is a header, an index of block_cnt entries
+ * (most recently used first), then the ids, data and vary lists
+ * they point to
+ */
+typedef struct cache_snapshot_header {
+    unsigned magic;
+    unsigned version;
+    unsigned block_cnt;
+    unsigned reserved;
+} CSH;
+
+typedef struct cache_snapshot_entry {
+    unsigned long id_off;       /* offset of the NUL-terminated id */
+    unsigned long data_off;     /* offset of the data */
+    unsigned long vary_off;     /* offset of the NUL-terminated vary list */
+    unsigned long vary_hash;
+    long expires;
+    unsigned id_len;
+    unsigned size;
+    unsigned vary_len;
+    unsigned encoding;
+    unsigned hdr_size;
+    unsigned body_size;
+    unsigned raw_size;
+    unsigned gzip_hdr_size;
+} CSE;
+
+CM *cache_create_new_cache (size_t max_cache_size, size_t max_object_size);
+
+void cache_destroy (CM *Cache);
+
+int cache_parse_policy (char *name);
+
+const char *cache_policy_name (int policy);
+
+size_t cache_parse_size (char *str);
+
+CB *cache_get (CM *Cache, char *key, char *req_hdrs);
+
+void cache_release (CM *Cache, CB *blk);
+
+int cache_check (CM *Cache, char *key, char *req_hdrs);
+
+void cache_insert (CM *Cache, char *key, char *req_hdrs,
+                   char *data, unsigned size);
+
+unsigned long cache_hash (const char *key);
+
+unsigned long cache_hash_continue (unsigned long hash, const char *key);
+
+unsigned long cache_vary_hash (const char *vary, char *req_hdrs);
+
+int cache_expired (long expires);
 
-CB *cache_get (CM *Cache, char *uri);
+int cache_snapshot_save (CM *Cache, char *path);
 
-int cache_check (CM *Cache, char *uri);
+int cache_snapshot_load (CM *Cache, char *path);
 
-void cache_insert (CM *Cache, char *uri, char *data, unsigned size);
\ No newline at end of file
+#endif /* __CACHE_H__ */
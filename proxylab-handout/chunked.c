@@ -0,0 +1,249 @@
+/* chunked
+ * a response relayed from the server goes through chunked_filter,
+ * which holds back the headers until they are complete, and, if the
+ * server sent the body with "Transfer-Encoding: chunked", drops that
+ * header and takes the chunk framing off the body as it streams by
+ * the client then gets a plain body ended by the close of the
+ * connection, which an HTTP/1.0 client understands as well, and the
+ * cache stores the plain body with its Content-Length (chunked_store)
+ *
+ * the body is decoded in place, a chunk of the relay at a time, and
+ * responses that are not chunked pass through without a copy
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include "csapp.h"
+#include "http.h"
+#include "chunked.h"
+
+//=========================================functions
+/* chunked_init
+ * starts filtering a response
+ */
+void chunked_init (CK *ck) {
+    ck->state = CK_HEAD;
+    ck->left = 0;
+    ck->digits = 0;
+    ck->line_len = 0;
+    ck->hdr = NULL;
+    ck->hdr_len = 0;
+    ck->hdr_cap = 0;
+    ck->hdr_size = 0;
+}
+
+/* chunked_free
+ * frees what the filter holds, once the response is relayed
+ */
+void chunked_free (CK *ck) {
+    if (ck->hdr) {
+        Free(ck->hdr);
+    }
+}
+
+/* chunked_hex
+ * returns the value of a hex digit, or -1
+ */
+static int chunked_hex (char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* chunked_decode
+ * takes the framing off n bytes of a chunked body, in place
+ * returns the number of data bytes left at buf, or -1 on bad framing
+ */
+static ssize_t chunked_decode (CK *ck, char *buf, size_t n) {
+    char *in = buf, *end = buf + n, *out = buf;
+    while (in < end && ck->state != CK_DONE) {
+        char c = *in;
+        switch (ck->state) {
+        case CK_SIZE:
+            if (chunked_hex(c) >= 0) {
+                ck->left = ck->left * 16 + chunked_hex(c);
+                if (++ck->digits > 10 || ck->left > CHUNKED_MAX_SIZE) {
+                    return -1;
+                }
+                in++;
+                break;
+            }
+            if (ck->digits == 0) {
+                return -1;
+            }
+            ck->state = CK_EXT;
+            /* fall through */
+        case CK_EXT:
+            /* extensions are ignored, up to the end of the line */
+            if (*in++ != '\n') {
+                break;
+            }
+            ck->digits = 0;
+            ck->line_len = 0;
+            ck->state = ck->left ? CK_DATA : CK_TRAILER;
+            break;
+        case CK_DATA: {
+            size_t len = end - in;
+            if (len > ck->left) {
+                len = ck->left;
+            }
+            memmove(out, in, len);
+            out += len;
+            in += len;
+            if ((ck->left -= len) == 0) {
+                ck->state = CK_DATA_END;
+            }
+            break;
+        }
+        case CK_DATA_END:
+            if (c == '\n') {
+                ck->state = CK_SIZE;
+            }
+            else if (c != '\r') {
+                return -1;
+            }
+            in++;
+            break;
+        case CK_TRAILER:
+            /* trailer fields are dropped, up to the blank line */
+            if (c == '\n') {
+                if (ck->line_len == 0) {
+                    ck->state = CK_DONE;
+                }
+                ck->line_len = 0;
+            }
+            else if (c != '\r') {
+                ck->line_len++;
+            }
+            in++;
+            break;
+        }
+    }
+    return out - buf;
+}
+
+/* chunked_strip_headers
+ * removes Transfer-Encoding and Content-Length from the headers of a
+ * chunked response, in place
+ * returns the new length of the headers
+ */
+static size_t chunked_strip_headers (char *hdr, size_t size) {
+    char *line = hdr, *end = hdr + size, *out = hdr;
+    while (line < end) {
+        char *eol = memchr(line, '\n', end - line);
+        size_t len = (eol ? eol + 1 : end) - line;
+        if (strncasecmp(line, "Transfer-Encoding:", 18) &&
+                strncasecmp(line, "Content-Length:", 15)) {
+            memmove(out, line, len);
+            out += len;
+        }
+        line += len;
+    }
+    return out - hdr;
+}
+
+/* chunked_headers
+ * looks at the headers once they are all held back, and passes them
+ * on with the body bytes received after them
+ * returns the number of bytes at *out, or -1 on bad framing
+ */
+static ssize_t chunked_headers (CK *ck, char **out) {
+    char value[MAXLINE];
+    size_t body_len = ck->hdr_len - ck->hdr_size;
+    ssize_t n;
+    *out = ck->hdr;
+    if (!http_header_value(ck->hdr, ck->hdr_size, "Transfer-Encoding",
+                           value, MAXLINE) ||
+            !http_token_match(value, "chunked")) {
+        ck->state = CK_PLAIN;
+        return ck->hdr_len;
+    }
+    size_t stripped = chunked_strip_headers(ck->hdr, ck->hdr_size);
+    memmove(ck->hdr + stripped, ck->hdr + ck->hdr_size, body_len);
+    ck->hdr_size = stripped;
+    ck->state = CK_SIZE;
+    if ((n = chunked_decode(ck, ck->hdr + stripped, body_len)) < 0) {
+        return -1;
+    }
+    return stripped + n;
+}
+
+/* chunked_filter
+ * passes n bytes of the response on; n is 0 at its end
+ * *out is set to the bytes to relay, which are valid until the next
+ * call and may be in place in the input
+ * returns their number, which may be 0, or -1 if the body is not
+ * properly chunked or ends before its last chunk
+ */
+ssize_t chunked_filter (CK *ck, char *in, size_t n, char **out) {
+    *out = in;
+    if (ck->state == CK_HEAD) {
+        if (n == 0) {
+            /* no end of the headers, the response is passed as it is */
+            ck->state = CK_PLAIN;
+            *out = ck->hdr;
+            return ck->hdr_len;
+        }
+        if (ck->hdr_len + n > ck->hdr_cap) {
+            ck->hdr_cap = ck->hdr_cap ? 2 * ck->hdr_cap : MAXBUF;
+            while (ck->hdr_cap < ck->hdr_len + n) {
+                ck->hdr_cap *= 2;
+            }
+            ck->hdr = Realloc(ck->hdr, ck->hdr_cap);
+        }
+        memcpy(ck->hdr + ck->hdr_len, in, n);
+        ck->hdr_len += n;
+        ck->hdr_size = http_header_end(ck->hdr, ck->hdr_len);
+        if (ck->hdr_size) {
+            return chunked_headers(ck, out);
+        }
+        if (ck->hdr_len > CHUNKED_MAX_HEADERS) {
+            ck->state = CK_PLAIN;
+            *out = ck->hdr;
+            return ck->hdr_len;
+        }
+        return 0;
+    }
+    if (ck->state == CK_PLAIN || ck->state == CK_DONE) {
+        return (ck->state == CK_PLAIN) ? n : 0;
+    }
+    if (n == 0) {
+        return -1;  /* the connection closed within the body */
+    }
+    return chunked_decode(ck, in, n);
+}
+
+/* chunked_decoded
+ * checks if the body of the response was chunked, and decoded
+ */
+int chunked_decoded (CK *ck) {
+    return ck->state >= CK_SIZE;
+}
+
+/* chunked_store
+ * given a decoded response obj of size bytes, as it was relayed,
+ * returns a copy with the length of its body in a Content-Length header,
+ * to be cached, and sets new_size to its size
+ */
+char *chunked_store (CK *ck, char *obj, size_t size, size_t *new_size) {
+    char length[MAXLINE];
+    char *eol = memchr(obj, '\n', ck->hdr_size);
+    size_t status_len = eol ? eol + 1 - obj : 0;
+    size_t len = snprintf(length, MAXLINE, "Content-Length: %lu\r\n",
+                          (unsigned long)(size - ck->hdr_size));
+    char *stored = Malloc(size + len);
+    memcpy(stored, obj, status_len);
+    memcpy(stored + status_len, length, len);
+    memcpy(stored + status_len + len, obj + status_len, size - status_len);
+    *new_size = size + len;
+    return stored;
+}
@@ -0,0 +1,44 @@
+/* This header file contains the interfaces to the filter that takes
+ * the chunked transfer coding off responses as they are relayed
+ */
+#ifndef __CHUNKED_H__
+#define __CHUNKED_H__
+
+#include "csapp.h"
+
+#define CHUNKED_MAX_HEADERS 65536   /* held back at most */
+#define CHUNKED_MAX_SIZE (1UL << 40) /* of one chunk */
+
+/* where the filter is in the response */
+#define CK_HEAD 0           /* holding back the headers */
+#define CK_PLAIN 1          /* not chunked, passed as it is */
+#define CK_SIZE 2           /* in the hex size of a chunk */
+#define CK_EXT 3            /* in the rest of the size line */
+#define CK_DATA 4           /* in the data of a chunk */
+#define CK_DATA_END 5       /* in the CRLF after the data */
+#define CK_TRAILER 6        /* in the trailer, after the last chunk */
+#define CK_DONE 7           /* past the end of the response */
+
+typedef struct chunked {
+    int state;
+    unsigned long left;         /* bytes left in the chunk (CK_DATA), or
+                                   its size so far (CK_SIZE) */
+    int digits;                 /* of the size so far */
+    unsigned line_len;          /* of the trailer line so far */
+    char *hdr;                  /* the headers held back */
+    size_t hdr_len;
+    size_t hdr_cap;
+    size_t hdr_size;            /* of the headers passed on, once known */
+} CK;
+
+void chunked_init (CK *ck);
+
+void chunked_free (CK *ck);
+
+ssize_t chunked_filter (CK *ck, char *in, size_t n, char **out);
+
+int chunked_decoded (CK *ck);
+
+char *chunked_store (CK *ck, char *obj, size_t size, size_t *new_size);
+
+#endif /* __CHUNKED_H__ */
@@ -0,0 +1,265 @@
+/* compress
+ * optional compressed storage for cached text responses
+ * the body of a compressible response is gzipped once when it is cached
+ * the block then holds the original headers, the gzip body, and a second
+ * set of headers (Content-Encoding: gzip and the compressed length):
+ *
+ *     | headers (hdr_size) | gzip body (body_size) | gzip headers |
+ *
+ * clients that accept gzip get the gzip headers and the body as stored,
+ * other clients get the original headers and a body inflated on the fly
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include <zlib.h>
+#include "csapp.h"
+#include "cache.h"
+#include "compress.h"
+#include "http.h"
+
+/* content types that are worth compressing */
+static const char *compressible_types[] = {
+    "text/", "application/json", "application/javascript",
+    "application/x-javascript", "application/xml", "image/svg+xml", NULL
+};
+
+//=========================================functions
+/* compress_is_compressible
+ * checks if a response with the given headers should be compressed
+ */
+static int compress_is_compressible (char *hdrs, size_t hdr_size) {
+    char value[MAXLINE];
+    int i;
+
+    if (http_status(hdrs, hdr_size) != 200 ||
+            http_header_value(hdrs, hdr_size, "Content-Encoding",
+                              value, MAXLINE) ||
+            http_header_value(hdrs, hdr_size, "Transfer-Encoding",
+                              value, MAXLINE) ||
+            !http_header_value(hdrs, hdr_size, "Content-Type",
+                               value, MAXLINE)) {
+        return 0;
+    }
+    for (i = 0; compressible_types[i]; i++) {
+        if (!strncasecmp(value, compressible_types[i],
+                         strlen(compressible_types[i]))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* compress_vary_covers
+ * checks if the Vary line from line to eol already lists
+ * Accept-Encoding, or is "*"
+ */
+static int compress_vary_covers (char *line, char *eol) {
+    char value[MAXLINE];
+    size_t len;
+
+    line += 5;                  /* "Vary:" */
+    while (line < eol && *line == ' ') {
+        line++;
+    }
+    len = eol - line;
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        len--;
+    }
+    len = (len < MAXLINE) ? len : MAXLINE - 1;
+    memcpy(value, line, len);
+    value[len] = '\0';
+    return http_token_match(value, "Accept-Encoding") ||
+           http_token_match(value, "*");
+}
+
+/* compress_gzip_headers
+ * writes the headers used with the gzip body into buf: the original
+ * ones without Content-Length, plus the encoding and the new length
+ * Accept-Encoding is added to the first Vary header, or in a Vary
+ * header of its own if there is none, so that there is only one
+ * returns the length of the headers
+ */
+static unsigned compress_gzip_headers (char *hdrs, size_t hdr_size,
+                                       unsigned body_size, char *buf) {
+    char *line, *eol, *end = hdrs + hdr_size - 2;  /* skip blank line */
+    unsigned n = 0;
+    int covered = 0, merged = 0;
+
+    for (line = hdrs; line < end; line = eol) {
+        eol = memchr(line, '\n', end - line);
+        eol = eol ? eol + 1 : end;
+        if (!strncasecmp(line, "Vary:", 5) &&
+                compress_vary_covers(line, eol)) {
+            covered = 1;
+        }
+    }
+    for (line = hdrs; line < end; line = eol) {
+        eol = memchr(line, '\n', end - line);
+        eol = eol ? eol + 1 : end;
+        if (!strncasecmp(line, "Content-Length:", 15)) {
+            continue;
+        }
+        if (!covered && !merged && !strncasecmp(line, "Vary:", 5)) {
+            char *value_end = eol;
+            while (value_end > line &&
+                   (value_end[-1] == '\n' || value_end[-1] == '\r')) {
+                value_end--;
+            }
+            memcpy(buf + n, line, value_end - line);
+            n += value_end - line;
+            n += sprintf(buf + n, ", Accept-Encoding\r\n");
+            merged = 1;
+            continue;
+        }
+        memcpy(buf + n, line, eol - line);
+        n += eol - line;
+    }
+    n += sprintf(buf + n, "Content-Encoding: gzip\r\n"
+                 "Content-Length: %u\r\n%s\r\n", body_size,
+                 (covered || merged) ? "" : "Vary: Accept-Encoding\r\n");
+    return n;
+}
+
+/* compress_block
+ * gzips the body of a fresh block in place if it is a text response
+ * and compression actually saves space
+ * returns 1 if the block was compressed, 0 if it is left as it is
+ */
+int compress_block (CB *blk) {
+    size_t hdr_size = http_header_end(blk->data, blk->size);
+    z_stream zs;
+
+    if (hdr_size == 0 || blk->size - hdr_size < COMPRESS_MIN_SIZE ||
+            !compress_is_compressible(blk->data, hdr_size)) {
+        return 0;
+    }
+    unsigned raw_size = blk->size - hdr_size;
+
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, COMPRESS_LEVEL, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return 0;
+    }
+    /* room for the headers twice, the gzip body and the added fields */
+    size_t bound = deflateBound(&zs, raw_size);
+    char *out = Malloc(2 * hdr_size + bound + MAXLINE);
+    memcpy(out, blk->data, hdr_size);
+    zs.next_in = (Bytef *)blk->data + hdr_size;
+    zs.avail_in = raw_size;
+    zs.next_out = (Bytef *)out + hdr_size;
+    zs.avail_out = bound;
+    int rc = deflate(&zs, Z_FINISH);
+    unsigned body_size = zs.total_out;
+    deflateEnd(&zs);
+    if (rc != Z_STREAM_END || body_size >= raw_size - raw_size / 10) {
+        Free(out);
+        return 0;
+    }
+
+    unsigned gzip_hdr_size = compress_gzip_headers(blk->data, hdr_size,
+            body_size, out + hdr_size + body_size);
+    Free(blk->data);
+    blk->size = hdr_size + body_size + gzip_hdr_size;
+    blk->data = Realloc(out, blk->size);
+    blk->encoding = CB_GZIP;
+    blk->hdr_size = hdr_size;
+    blk->body_size = body_size;
+    blk->raw_size = raw_size;
+    blk->gzip_hdr_size = gzip_hdr_size;
+    return 1;
+}
+
+/* compress_inflate
+ * inflates the body of a compressed block, handing every MAXBUF bytes
+ * of output to sink (a write to a socket or a copy into a buffer)
+ * returns 0 on success, -1 on error
+ */
+static int compress_inflate (CB *blk, int (*sink)(void *, char *, size_t),
+                             void *arg) {
+    z_stream zs;
+    char buf[MAXBUF];
+    int rc = Z_OK;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        return -1;
+    }
+    zs.next_in = (Bytef *)blk->data + blk->hdr_size;
+    zs.avail_in = blk->body_size;
+    while (rc != Z_STREAM_END) {
+        zs.next_out = (Bytef *)buf;
+        zs.avail_out = MAXBUF;
+        rc = inflate(&zs, Z_NO_FLUSH);
+        if ((rc != Z_OK && rc != Z_STREAM_END) ||
+                sink(arg, buf, MAXBUF - zs.avail_out) < 0) {
+            inflateEnd(&zs);
+            return -1;
+        }
+    }
+    inflateEnd(&zs);
+    return 0;
+}
+
+static int compress_sink_fd (void *arg, char *buf, size_t n) {
+    return rio_writen(*(int *)arg, buf, n) < 0 ? -1 : 0;
+}
+
+/* where compress_expand inflates to */
+typedef struct compress_dst {
+    char *ptr;
+    char *end;
+} compress_dst;
+
+static int compress_sink_buf (void *arg, char *buf, size_t n) {
+    compress_dst *dst = (compress_dst *)arg;
+    if (n > dst->end - dst->ptr) {
+        return -1;
+    }
+    memcpy(dst->ptr, buf, n);
+    dst->ptr += n;
+    return 0;
+}
+
+/* compress_serve
+ * sends a compressed block to fd, as stored if the client accepts gzip,
+ * or inflated otherwise
+ * returns the number of bytes sent, -1 on error
+ */
+ssize_t compress_serve (CB *blk, int fd, int accept_gzip) {
+    if (accept_gzip) {
+        /* the gzip headers are stored after the body */
+        struct iovec iov[2];
+        iov[0].iov_base = blk->data + blk->hdr_size + blk->body_size;
+        iov[0].iov_len = blk->gzip_hdr_size;
+        iov[1].iov_base = blk->data + blk->hdr_size;
+        iov[1].iov_len = blk->body_size;
+        return rio_writevn(fd, iov, 2);
+    }
+    if (rio_writen(fd, blk->data, blk->hdr_size) < 0 ||
+            compress_inflate(blk, compress_sink_fd, &fd) < 0) {
+        return -1;
+    }
+    return blk->hdr_size + blk->raw_size;
+}
+
+/* compress_expand
+ * rebuilds the original response of a compressed block
+ * returns a malloc'ed buffer of *size bytes, or NULL on error
+ */
+char *compress_expand (CB *blk, unsigned *size) {
+    char *raw = Malloc(blk->hdr_size + blk->raw_size);
+    compress_dst dst;
+    dst.ptr = raw + blk->hdr_size;
+    dst.end = dst.ptr + blk->raw_size;
+    memcpy(raw, blk->data, blk->hdr_size);
+    if (compress_inflate(blk, compress_sink_buf, &dst) < 0 ||
+            dst.ptr != dst.end) {
+        Free(raw);
+        return NULL;
+    }
+    *size = dst.ptr - raw;
+    return raw;
+}
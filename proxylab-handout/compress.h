@@ -0,0 +1,17 @@
+/* This header file contains the interfaces to compressed cache storage
+ */
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include "cache.h"
+
+#define COMPRESS_LEVEL 1        /* fastest zlib level */
+#define COMPRESS_MIN_SIZE 512   /* smaller bodies are not worth it */
+
+int compress_block (CB *blk);
+
+ssize_t compress_serve (CB *blk, int fd, int accept_gzip);
+
+char *compress_expand (CB *blk, unsigned *size);
+
+#endif /* __COMPRESS_H__ */
@@ -0,0 +1,335 @@
+/* coro
+ * stackful coroutines with one scheduler per thread
+ * a coroutine runs ordinary blocking-style code, doit included, on its
+ * own stack; when a non-blocking descriptor is not ready, the rio
+ * functions call co_wait_fd through the rio wait hook, which registers
+ * the descriptor with the scheduler's epoll instance and switches to
+ * the next ready coroutine
+ * the scheduler waits in epoll_wait only when no coroutine is ready, so
+ * a thread keeps thousands of requests in flight without the code being
+ * turned into a state machine
+ * a wait may have a deadline: timed waits are kept in a list sorted by
+ * deadline, whose head bounds epoll_wait, and a coroutine whose deadline
+ * passes is woken with ETIMEDOUT
+ *
+ * a coroutine must not hold a lock across a wait, as the coroutine that
+ * runs next on the thread may want the same lock; and a blocking call
+ * that does not go through rio (getaddrinfo, say) stalls the whole thread
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include <sys/epoll.h>
+#include <time.h>
+#include "csapp.h"
+#include "coro.h"
+
+/* the scheduler running on this thread, or NULL */
+static __thread SCH *co_sched;
+
+//=========================================functions
+/* co_scheduler_create
+ * returns an empty scheduler, to be run with co_run
+ */
+SCH *co_scheduler_create (void) {
+    SCH *sched = Calloc(1, sizeof(SCH));
+    if ((sched->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        unix_error("epoll_create1 error");
+    }
+    return sched;
+}
+
+/* co_push
+ * appends a coroutine to the run queue
+ */
+static void co_push (SCH *sched, CO *co) {
+    co->next = NULL;
+    if (sched->run_tail) {
+        sched->run_tail->next = co;
+    }
+    else {
+        sched->run_head = co;
+    }
+    sched->run_tail = co;
+}
+
+/* co_pop
+ * removes the first coroutine of the run queue
+ */
+static CO *co_pop (SCH *sched) {
+    CO *co = sched->run_head;
+    sched->run_head = co->next;
+    if (sched->run_head == NULL) {
+        sched->run_tail = NULL;
+    }
+    return co;
+}
+
+/* co_now_ms
+ * returns the monotonic time in ms
+ */
+static unsigned long co_now_ms (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+/* co_timer_add
+ * puts a coroutine with a deadline in the timer list; the search starts
+ * at the tail, where waits with the same timeout go
+ */
+static void co_timer_add (SCH *sched, CO *co) {
+    CO *prev = sched->timer_tail;
+    while (prev && prev->deadline > co->deadline) {
+        prev = prev->timer_prev;
+    }
+    co->timer_prev = prev;
+    co->timer_next = prev ? prev->timer_next : sched->timer_head;
+    if (co->timer_next) {
+        co->timer_next->timer_prev = co;
+    }
+    else {
+        sched->timer_tail = co;
+    }
+    if (prev) {
+        prev->timer_next = co;
+    }
+    else {
+        sched->timer_head = co;
+    }
+}
+
+/* co_timer_remove
+ * takes a coroutine out of the timer list, if it is in it
+ */
+static void co_timer_remove (SCH *sched, CO *co) {
+    if (co->deadline == 0) {
+        return;
+    }
+    if (co->timer_prev) {
+        co->timer_prev->timer_next = co->timer_next;
+    }
+    else {
+        sched->timer_head = co->timer_next;
+    }
+    if (co->timer_next) {
+        co->timer_next->timer_prev = co->timer_prev;
+    }
+    else {
+        sched->timer_tail = co->timer_prev;
+    }
+    co->deadline = 0;
+}
+
+/* co_wake
+ * makes a coroutine waiting in co_wait_fd ready to run
+ */
+static void co_wake (SCH *sched, CO *co, int timed_out) {
+    if (!co->waiting) {
+        return;
+    }
+    co->waiting = 0;
+    co->timed_out = timed_out;
+    co_timer_remove(sched, co);
+    co_push(sched, co);
+}
+
+/* co_expire
+ * wakes the coroutines whose deadline has passed, after disabling the
+ * descriptor each waits for
+ * returns the ms until the next deadline, or -1 if there is none
+ */
+static int co_expire (SCH *sched) {
+    struct epoll_event ev;
+    unsigned long now = co_now_ms();
+    CO *co;
+    while ((co = sched->timer_head) != NULL && co->deadline <= now) {
+        ev.events = 0;
+        ev.data.ptr = co;
+        epoll_ctl(sched->epoll_fd, EPOLL_CTL_MOD, co->wait_fd, &ev);
+        co_wake(sched, co, 1);
+    }
+    return co ? (int)(co->deadline - now) : -1;
+}
+
+/* co_main
+ * the entry point of every coroutine; returning switches to uc_link,
+ * the scheduler
+ */
+static void co_main (void) {
+    CO *co = co_sched->current;
+    co->fn(co->arg);
+    co->done = 1;
+}
+
+/* co_spawn
+ * creates a coroutine running fn(arg), ready to run
+ */
+CO *co_spawn (SCH *sched, void (*fn)(void *arg), void *arg) {
+    CO *co = sched->free;
+    long page = sysconf(_SC_PAGESIZE);
+    if (co) {
+        sched->free = co->next;
+        sched->free_cnt--;
+    }
+    else {
+        co = Calloc(1, sizeof(CO));
+        co->stack = Mmap(NULL, CO_STACK_SIZE + page, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        /* an overflow faults on the guard page instead of corrupting */
+        if (mprotect(co->stack, page, PROT_NONE) < 0) {
+            unix_error("mprotect error");
+        }
+    }
+    if (getcontext(&co->ctx) < 0) {
+        unix_error("getcontext error");
+    }
+    co->ctx.uc_stack.ss_sp = co->stack + page;
+    co->ctx.uc_stack.ss_size = CO_STACK_SIZE;
+    co->ctx.uc_link = &sched->ctx;
+    makecontext(&co->ctx, co_main, 0);
+    co->fn = fn;
+    co->arg = arg;
+    co->done = 0;
+    co->waiting = 0;
+    co->deadline = 0;
+    sched->live++;
+    co_push(sched, co);
+    return co;
+}
+
+/* co_finish
+ * recycles a coroutine that returned, and wakes co_wait_exit
+ */
+static void co_finish (SCH *sched, CO *co) {
+    sched->live--;
+    if (sched->exit_waiter) {
+        co_push(sched, sched->exit_waiter);
+        sched->exit_waiter = NULL;
+    }
+    if (sched->free_cnt < CO_FREE_MAX) {
+        co->next = sched->free;
+        sched->free = co;
+        sched->free_cnt++;
+    }
+    else {
+        Munmap(co->stack, CO_STACK_SIZE + sysconf(_SC_PAGESIZE));
+        Free(co);
+    }
+}
+
+/* co_run
+ * runs the coroutines on the calling thread until none is left
+ */
+void co_run (SCH *sched) {
+    struct epoll_event events[CO_MAX_EVENTS];
+    int i, n, timeout;
+    co_sched = sched;
+    rio_set_wait_hook(co_wait_fd);
+    while (sched->live > 0) {
+        while (sched->run_head) {
+            CO *co = co_pop(sched);
+            sched->current = co;
+            if (swapcontext(&sched->ctx, &co->ctx) < 0) {
+                unix_error("swapcontext error");
+            }
+            sched->current = NULL;
+            if (co->done) {
+                co_finish(sched, co);
+            }
+        }
+        if (sched->live == 0) {
+            break;
+        }
+        timeout = co_expire(sched);
+        if (sched->run_head) {
+            continue;
+        }
+        if ((n = epoll_wait(sched->epoll_fd, events, CO_MAX_EVENTS,
+                            timeout)) < 0) {
+            if (errno != EINTR) {
+                unix_error("epoll_wait error");
+            }
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            co_wake(sched, events[i].data.ptr, 0);
+        }
+        co_expire(sched);
+    }
+    rio_set_wait_hook(NULL);
+    co_sched = NULL;
+}
+
+/* co_scheduler
+ * returns the scheduler running on this thread, or NULL
+ */
+SCH *co_scheduler (void) {
+    return co_sched;
+}
+
+/* co_switch
+ * switches from the current coroutine back to the scheduler
+ */
+static void co_switch (SCH *sched) {
+    if (swapcontext(&sched->current->ctx, &sched->ctx) < 0) {
+        unix_error("swapcontext error");
+    }
+}
+
+/* co_yield
+ * lets the other ready coroutines run before this one goes on
+ */
+void co_yield (void) {
+    co_push(co_sched, co_sched->current);
+    co_switch(co_sched);
+}
+
+/* co_wait_fd
+ * the rio wait hook: sleeps until fd is ready for events
+ * (POLLIN, POLLOUT), or has an error the next call will report, or
+ * for at most timeout_ms if it is not -1
+ * returns 0, or -1 outside a coroutine, on error or with errno ETIMEDOUT
+ */
+int co_wait_fd (int fd, short events, int timeout_ms) {
+    SCH *sched = co_sched;
+    CO *co;
+    struct epoll_event ev;
+    if (sched == NULL || sched->current == NULL) {
+        errno = EAGAIN;
+        return -1;
+    }
+    ev.events = EPOLLONESHOT;
+    ev.events |= (events & POLLIN) ? EPOLLIN : 0;
+    ev.events |= (events & POLLOUT) ? EPOLLOUT : 0;
+    ev.data.ptr = sched->current;
+    /* a descriptor stays registered, disabled, after its wake-up */
+    if (epoll_ctl(sched->epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0 &&
+            (errno != ENOENT ||
+             epoll_ctl(sched->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)) {
+        return -1;
+    }
+    co = sched->current;
+    co->waiting = 1;
+    if (timeout_ms >= 0) {
+        co->wait_fd = fd;
+        co->deadline = co_now_ms() + timeout_ms;
+        co_timer_add(sched, co);
+    }
+    co_switch(sched);
+    if (co->timed_out) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return 0;
+}
+
+/* co_wait_exit
+ * sleeps until another coroutine of this scheduler finishes
+ */
+void co_wait_exit (void) {
+    co_sched->exit_waiter = co_sched->current;
+    co_switch(co_sched);
+}
@@ -0,0 +1,57 @@
+/* This header file contains the interfaces to the coroutine scheduler,
+ * which runs many blocking-style requests on one thread
+ */
+#ifndef __CORO_H__
+#define __CORO_H__
+
+#include <ucontext.h>
+#include "csapp.h"
+
+#define CO_STACK_SIZE (128 * 1024)  /* request buffers are in arenas */
+#define CO_FREE_MAX 64          /* finished stacks kept for reuse */
+#define CO_MAX_EVENTS 64        /* epoll events taken at once */
+
+typedef struct coroutine {
+    struct coroutine *next;     /* in the run queue or the free list */
+    ucontext_t ctx;
+    char *stack;                /* mapped with a guard page below it */
+    void (*fn)(void *arg);
+    void *arg;
+    int done;
+    int waiting;                /* for a descriptor, in co_wait_fd */
+    int timed_out;              /* the wait ended at its deadline */
+    int wait_fd;
+    unsigned long deadline;     /* of a timed wait, in ms, or 0 */
+    struct coroutine *timer_prev; /* in the timer list, by deadline */
+    struct coroutine *timer_next;
+} CO;
+
+typedef struct scheduler {
+    ucontext_t ctx;             /* where coroutines switch back to */
+    CO *current;
+    CO *run_head;               /* coroutines ready to run */
+    CO *run_tail;
+    CO *free;
+    unsigned free_cnt;
+    CO *exit_waiter;            /* in co_wait_exit, or NULL */
+    unsigned live;              /* coroutines not finished */
+    CO *timer_head;             /* timed waits, earliest first */
+    CO *timer_tail;
+    int epoll_fd;
+} SCH;
+
+SCH *co_scheduler_create (void);
+
+CO *co_spawn (SCH *sched, void (*fn)(void *arg), void *arg);
+
+void co_run (SCH *sched);
+
+SCH *co_scheduler (void);
+
+void co_yield (void);
+
+int co_wait_fd (int fd, short events, int timeout_ms);
+
+void co_wait_exit (void);
+
+#endif /* __CORO_H__ */
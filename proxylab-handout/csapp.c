@@ -524,6 +524,57 @@ void V(sem_t *sem)
 /*********************************************************************
  * The Rio package - robust I/O functions
  **********************************************************************/
+/*
+ * rio_wait_hook - if set, called when a non-blocking descriptor is not
+ *     ready, to wait without blocking the thread (e.g. by switching
+ *     to another coroutine); set per thread with rio_set_wait_hook
+ */
+static __thread int (*rio_wait_hook)(int fd, short events, int timeout_ms);
+
+void rio_set_wait_hook(int (*hook)(int fd, short events, int timeout_ms))
+{
+    rio_wait_hook = hook;
+}
+
+int rio_has_wait_hook(void)
+{
+    return rio_wait_hook != NULL;
+}
+
+/*
+ * rio_wait_fd - wait until fd is ready for events (POLLIN, POLLOUT)
+ *     Returns 0 when ready, -1 on error.
+ */
+int rio_wait_fd(int fd, short events)
+{
+    return rio_wait_fd_timeout(fd, events, -1);
+}
+
+/*
+ * rio_wait_fd_timeout - rio_wait_fd, for at most timeout_ms (-1 waits
+ *     forever)
+ *     Returns 0 when ready, -1 on error or with errno ETIMEDOUT.
+ */
+int rio_wait_fd_timeout(int fd, short events, int timeout_ms)
+{
+    struct pollfd pfd;
+    int rc;
+
+    if (rio_wait_hook)
+	return rio_wait_hook(fd, events, timeout_ms);
+    pfd.fd = fd;
+    pfd.events = events;
+    while ((rc = poll(&pfd, 1, timeout_ms)) < 0) {
+	if (errno != EINTR)
+	    return -1;
+    }
+    if (rc == 0) {
+	errno = ETIMEDOUT;
+	return -1;
+    }
+    return 0;
+}
+
 /*
  * rio_readn - robustly read n bytes (unbuffered)
  */
@@ -538,6 +589,8 @@ ssize_t rio_readn(int fd, void *usrbuf, size_t n)
 	if ((nread = read(fd, bufp, nleft)) < 0) {
 	    if (errno == EINTR) /* interrupted by sig handler return */
 		nread = 0;      /* and call read() again */
+	    else if (errno == EAGAIN && rio_wait_fd(fd, POLLIN) == 0)
+		nread = 0;      /* non-blocking fd, now readable */
 	    else
 		return -1;      /* errno set by read() */ 
 	} 
@@ -564,6 +617,9 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 	if ((nwritten = write(fd, bufp, nleft)) <= 0) {
 	    if (errno == EINTR)  /* interrupted by sig handler return */
 		nwritten = 0;    /* and call write() again */
+	    else if (nwritten < 0 && errno == EAGAIN &&
+		     rio_wait_fd(fd, POLLOUT) == 0)
+		nwritten = 0;    /* non-blocking fd, now writable */
 	    else
 		return -1;       /* errorno set by write() */
 	}
@@ -574,6 +630,43 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 }
 /* $end rio_writen */
 
+/*
+ * rio_writevn - robustly write the iovcnt buffers of iov (unbuffered)
+ *     with as few writev calls as the descriptor allows; iov is
+ *     advanced past what each call wrote
+ *     Returns the number of bytes written, -1 on error.
+ */
+ssize_t rio_writevn(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t n = 0;
+    ssize_t nwritten;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+	n += iov[i].iov_len;
+    while (iovcnt > 0) {
+	if ((nwritten = writev(fd, iov, iovcnt)) < 0) {
+	    if (errno == EINTR)  /* interrupted by sig handler return */
+		nwritten = 0;    /* and call writev() again */
+	    else if (errno == EAGAIN && rio_wait_fd(fd, POLLOUT) == 0)
+		nwritten = 0;    /* non-blocking fd, now writable */
+	    else
+		return -1;       /* errno set by writev() */
+	}
+	/* skip the buffers written, and the part of the next one */
+	while (iovcnt > 0 && nwritten >= iov->iov_len) {
+	    nwritten -= iov->iov_len;
+	    iov++;
+	    iovcnt--;
+	}
+	if (iovcnt > 0) {
+	    iov->iov_base = (char *)iov->iov_base + nwritten;
+	    iov->iov_len -= nwritten;
+	}
+    }
+    return n;
+}
+
 
 /* 
  * rio_read - This is a wrapper for the Unix read() function that
@@ -592,7 +685,11 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
 	rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, 
 			   sizeof(rp->rio_buf));
 	if (rp->rio_cnt < 0) {
-	    if (errno != EINTR) /* interrupted by sig handler return */
+	    if (errno == EAGAIN) { /* non-blocking fd, wait until readable */
+		if (rio_wait_fd(rp->rio_fd, POLLIN) < 0)
+		    return -1;
+	    }
+	    else if (errno != EINTR) /* interrupted by sig handler return */
 		return -1;
 	}
 	else if (rp->rio_cnt == 0)  /* EOF */
@@ -677,6 +774,163 @@ ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
 }
 /* $end rio_readlineb */
 
+/*
+ * The riob variant - like the buffered rio functions, but the buffer
+ * lives on the heap and grows as needed, peek/consume give access to
+ * the buffered bytes without copying them, and large reads bypass it
+ */
+
+/*
+ * riob_init - associate a descriptor with a buffer of size bytes,
+ *     which may grow up to max bytes; release it with riob_free
+ */
+void riob_init(riob_t *rp, int fd, size_t size, size_t max)
+{
+    rp->rio_fd = fd;
+    rp->rio_cnt = 0;
+    rp->rio_size = size;
+    rp->rio_max = (max > size) ? max : size;
+    rp->rio_buf = Malloc(size);
+    rp->rio_bufptr = rp->rio_buf;
+}
+
+void riob_free(riob_t *rp)
+{
+    Free(rp->rio_buf);
+    rp->rio_buf = rp->rio_bufptr = NULL;
+}
+
+/*
+ * riob_fill - read once more into the buffer, after the unread bytes
+ *     The unread bytes are moved to the front first, and the buffer
+ *     doubles when they fill it, or when the last read filled it.
+ *     Returns the bytes added, 0 on EOF, -1 on error (ENOBUFS if the
+ *     unread bytes already fill a buffer of rio_max bytes).
+ */
+ssize_t riob_fill(riob_t *rp)
+{
+    ssize_t nread;
+    size_t room;
+
+    if (rp->rio_bufptr != rp->rio_buf) {
+	memmove(rp->rio_buf, rp->rio_bufptr, rp->rio_cnt);
+	rp->rio_bufptr = rp->rio_buf;
+    }
+    if (rp->rio_cnt == rp->rio_size) {
+	if (rp->rio_size == rp->rio_max) {
+	    errno = ENOBUFS;
+	    return -1;
+	}
+	rp->rio_size = (2 * rp->rio_size < rp->rio_max) ?
+	    2 * rp->rio_size : rp->rio_max;
+	rp->rio_buf = rp->rio_bufptr = Realloc(rp->rio_buf, rp->rio_size);
+    }
+    room = rp->rio_size - rp->rio_cnt;
+    while ((nread = read(rp->rio_fd, rp->rio_buf + rp->rio_cnt, room)) < 0) {
+	if (errno == EAGAIN) { /* non-blocking fd, wait until readable */
+	    if (rio_wait_fd(rp->rio_fd, POLLIN) < 0)
+		return -1;
+	}
+	else if (errno != EINTR) /* interrupted by sig handler return */
+	    return -1;
+    }
+    rp->rio_cnt += nread;
+    /* a busy stream gets a larger buffer, and fewer reads */
+    if (nread == room && rp->rio_size < rp->rio_max) {
+	size_t size = (2 * rp->rio_size < rp->rio_max) ?
+	    2 * rp->rio_size : rp->rio_max;
+	rp->rio_buf = rp->rio_bufptr = Realloc(rp->rio_buf, size);
+	rp->rio_size = size;
+    }
+    return nread;
+}
+
+/*
+ * riob_peek - return the unread bytes, reading if there are none,
+ *     and set *cnt to their number (0 on EOF)
+ *     The bytes stay valid until the next call other than
+ *     riob_consume. Returns NULL on error.
+ */
+char *riob_peek(riob_t *rp, size_t *cnt)
+{
+    if (rp->rio_cnt == 0 && riob_fill(rp) < 0)
+	return NULL;
+    *cnt = rp->rio_cnt;
+    return rp->rio_bufptr;
+}
+
+/*
+ * riob_consume - mark n of the bytes returned by riob_peek as read
+ */
+void riob_consume(riob_t *rp, size_t n)
+{
+    rp->rio_bufptr += n;
+    rp->rio_cnt -= n;
+}
+
+/*
+ * riob_readnb - robustly read n bytes
+ *     Once the buffered bytes are used up, a remainder at least as
+ *     large as the buffer is read straight into usrbuf.
+ */
+ssize_t riob_readnb(riob_t *rp, void *usrbuf, size_t n)
+{
+    size_t nleft = n, cnt;
+    ssize_t nread;
+    char *bufp = usrbuf;
+
+    while (nleft > 0) {
+	if (rp->rio_cnt == 0 && nleft >= rp->rio_size) {
+	    if ((nread = rio_readn(rp->rio_fd, bufp, nleft)) < 0)
+		return -1;
+	    nleft -= nread;
+	    break;
+	}
+	if (rp->rio_cnt == 0 && (nread = riob_fill(rp)) <= 0) {
+	    if (nread < 0)
+		return -1;
+	    break;              /* EOF */
+	}
+	cnt = (rp->rio_cnt < nleft) ? rp->rio_cnt : nleft;
+	memcpy(bufp, rp->rio_bufptr, cnt);
+	riob_consume(rp, cnt);
+	nleft -= cnt;
+	bufp += cnt;
+    }
+    return (n - nleft);         /* return >= 0 */
+}
+
+/*
+ * riob_readlineb - robustly read a text line of at most maxlen - 1
+ *     bytes, found with memchr in the buffered bytes
+ *     Returns the length of the line, 0 on EOF, -1 on error.
+ */
+ssize_t riob_readlineb(riob_t *rp, void *usrbuf, size_t maxlen)
+{
+    size_t scanned = 0, len;
+    char *eol;
+
+    while (1) {
+	len = (rp->rio_cnt < maxlen - 1) ? rp->rio_cnt : maxlen - 1;
+	if ((eol = memchr(rp->rio_bufptr + scanned, '\n', len - scanned))) {
+	    len = eol + 1 - rp->rio_bufptr;
+	    break;
+	}
+	if (len == maxlen - 1)
+	    break;              /* no room for the rest of the line */
+	scanned = len;
+	ssize_t nread = riob_fill(rp);
+	if (nread < 0 && errno != ENOBUFS)
+	    return -1;
+	if (nread <= 0)
+	    break;              /* EOF or a full buffer, with some data */
+    }
+    memcpy(usrbuf, rp->rio_bufptr, len);
+    ((char *)usrbuf)[len] = '\0';
+    riob_consume(rp, len);
+    return len;
+}
+
 /**********************************
  * Wrappers for robust I/O routines
  **********************************/
@@ -757,80 +1011,150 @@ int open_clientfd(char *hostname, int port)
 /* $end open_clientfd */
 
 /*
- * open_clientfd_r - thread-safe version of open_clientfd
+ * resolve_host_r - looks up the addresses of hostname:port, to be
+ *     passed to connect_addrinfo and released with freeaddrinfo
+ *     Returns -1 on error.
  */
-int open_clientfd_r(char *hostname, int port) {
-    int clientfd;
-    struct addrinfo *addlist, *p;
+int resolve_host_r(char *hostname, int port, struct addrinfo **addlist) {
     char port_str[MAXLINE];
-    int rv;
 
-    /* Create the socket descriptor */
-    if ((clientfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    sprintf(port_str, "%d", port);
+    if (getaddrinfo(hostname, port_str, NULL, addlist) != 0) {
         return -1;
     }
+    return 0;
+}
 
-    /* Get a list of addrinfo structs */
-    sprintf(port_str, "%d", port);
-    if ((rv = getaddrinfo(hostname, port_str, NULL, &addlist)) != 0) {
+/*
+ * connect_addrinfo - connects to the first IPv4 address of addlist
+ *     that accepts the connection
+ *     With a rio wait hook, the socket is non-blocking and the hook
+ *     waits for the connection to complete.
+ *     Returns the socket, or -1 on error.
+ */
+int connect_addrinfo(struct addrinfo *addlist) {
+    int clientfd, err;
+    socklen_t len = sizeof(err);
+    struct addrinfo *p;
+
+    /* Create the socket descriptor */
+    if ((clientfd = socket(AF_INET, SOCK_STREAM |
+                           (rio_wait_hook ? SOCK_NONBLOCK : 0), 0)) < 0) {
         return -1;
     }
-  
+
     /* Walk the list, using each addrinfo to try to connect */
     for (p = addlist; p; p = p->ai_next) {
         if ((p->ai_family == AF_INET)) {
             if (connect(clientfd, p->ai_addr, p->ai_addrlen) == 0) {
-                break; /* success */
+                return clientfd; /* success */
+            }
+            if (errno == EINPROGRESS &&
+                    rio_wait_fd(clientfd, POLLOUT) == 0 &&
+                    getsockopt(clientfd, SOL_SOCKET, SO_ERROR,
+                               &err, &len) == 0 && err == 0) {
+                return clientfd; /* success, non-blocking */
             }
         }
-    } 
+    }
 
-    /* Clean up */
-    freeaddrinfo(addlist);
-    if (!p) { /* all connects failed */
-        close(clientfd);
+    /* all connects failed */
+    close(clientfd);
+    return -1;
+}
+
+/*
+ * open_clientfd_r - thread-safe version of open_clientfd
+ */
+int open_clientfd_r(char *hostname, int port) {
+    struct addrinfo *addlist;
+    int clientfd;
+
+    /* Get a list of addrinfo structs */
+    if (resolve_host_r(hostname, port, &addlist) < 0) {
         return -1;
     }
-    else { /* one of the connects succeeded */
-        return clientfd;
-    }
+    clientfd = connect_addrinfo(addlist);
+
+    /* Clean up */
+    freeaddrinfo(addlist);
+    return clientfd;
 }
 
-/*  
- * open_listenfd - open and return a listening socket on port
+/*
+ * listenfd_open - open and return a listening socket on port, bound
+ *     to addr (in host byte order), with SO_REUSEPORT if reuseport is
+ *     set; the open_*listenfd functions below differ only in those
  *     Returns -1 and sets errno on Unix error.
  */
-/* $begin open_listenfd */
-int open_listenfd(int port) 
+static int listenfd_open(int port, unsigned addr, int reuseport)
 {
     int listenfd, optval=1;
     struct sockaddr_in serveraddr;
-  
+
     /* Create a socket descriptor */
     if ((listenfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
 	return -1;
- 
+
     /* Eliminates "Address already in use" error from bind. */
-    if (setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, 
+    if (setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR,
 		   (const void *)&optval , sizeof(int)) < 0)
-	return -1;
+	goto err;
+    if (reuseport && setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT,
+				(const void *)&optval , sizeof(int)) < 0)
+	goto err;
 
     /* Listenfd will be an endpoint for all requests to port
-       on any IP address for this host */
+       on addr */
     bzero((char *) &serveraddr, sizeof(serveraddr));
-    serveraddr.sin_family = AF_INET; 
-    serveraddr.sin_addr.s_addr = htonl(INADDR_ANY); 
-    serveraddr.sin_port = htons((unsigned short)port); 
+    serveraddr.sin_family = AF_INET;
+    serveraddr.sin_addr.s_addr = htonl(addr);
+    serveraddr.sin_port = htons((unsigned short)port);
     if (bind(listenfd, (SA *)&serveraddr, sizeof(serveraddr)) < 0)
-	return -1;
+	goto err;
 
     /* Make it a listening socket ready to accept connection requests */
     if (listen(listenfd, LISTENQ) < 0)
-	return -1;
+	goto err;
     return listenfd;
+
+ err:
+    close(listenfd);
+    return -1;
+}
+
+/*  
+ * open_listenfd - open and return a listening socket on port
+ *     Returns -1 and sets errno on Unix error.
+ */
+/* $begin open_listenfd */
+int open_listenfd(int port) 
+{
+    return listenfd_open(port, INADDR_ANY, 0);
 }
 /* $end open_listenfd */
 
+/*
+ * open_local_listenfd - like open_listenfd, but only accepts
+ *     connections on the loopback interface
+ *     Returns -1 and sets errno on Unix error.
+ */
+int open_local_listenfd(int port)
+{
+    return listenfd_open(port, INADDR_LOOPBACK, 0);
+}
+
+/*
+ * open_reuseport_listenfd - like open_listenfd, but with SO_REUSEPORT,
+ *     so that several sockets can listen on the same port and the
+ *     kernel spreads the incoming connections among them
+ *     Returns -1 and sets errno on Unix error.
+ */
+int open_reuseport_listenfd(int port)
+{
+    return listenfd_open(port, INADDR_ANY, 1);
+}
+
 /******************************************
  * Wrappers for the client/server helper routines 
  ******************************************/
@@ -23,6 +23,8 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <poll.h>
+#include <sys/uio.h>
 
 
 /* Default file permissions are DEF_MODE & ~DEF_UMASK */
@@ -47,6 +49,20 @@ typedef struct {
 } rio_t;
 /* $end rio_t */
 
+/* Persistent state for the growable Rio variant (riob); its buffer
+ * starts at rio_size bytes and doubles, up to rio_max, for long lines
+ * and for streams that keep filling it
+ */
+#define RIOB_MAXSIZE 65536
+typedef struct {
+    int rio_fd;                /* descriptor for this internal buf */
+    size_t rio_cnt;            /* unread bytes in internal buf */
+    char *rio_bufptr;          /* next unread byte in internal buf */
+    char *rio_buf;             /* internal buffer, on the heap */
+    size_t rio_size;           /* current size of rio_buf */
+    size_t rio_max;            /* largest size rio_buf may grow to */
+} riob_t;
+
 /* External variables */
 extern int h_errno;    /* defined by BIND for DNS errors */ 
 extern char **environ; /* defined by libc */
@@ -143,11 +159,23 @@ void P(sem_t *sem);
 void V(sem_t *sem);
 
 /* Rio (Robust I/O) package */
+void rio_set_wait_hook(int (*hook)(int fd, short events, int timeout_ms));
+int rio_has_wait_hook(void);
+int rio_wait_fd(int fd, short events);
+int rio_wait_fd_timeout(int fd, short events, int timeout_ms);
 ssize_t rio_readn(int fd, void *usrbuf, size_t n);
 ssize_t rio_writen(int fd, void *usrbuf, size_t n);
+ssize_t rio_writevn(int fd, struct iovec *iov, int iovcnt);
 void rio_readinitb(rio_t *rp, int fd); 
 ssize_t	rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t	rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+void riob_init(riob_t *rp, int fd, size_t size, size_t max);
+void riob_free(riob_t *rp);
+ssize_t riob_fill(riob_t *rp);
+char *riob_peek(riob_t *rp, size_t *cnt);
+void riob_consume(riob_t *rp, size_t n);
+ssize_t riob_readnb(riob_t *rp, void *usrbuf, size_t n);
+ssize_t riob_readlineb(riob_t *rp, void *usrbuf, size_t maxlen);
 
 /* Wrappers for Rio package */
 ssize_t Rio_readn(int fd, void *usrbuf, size_t n);
@@ -159,7 +187,11 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
 /* Client/server helper functions */
 int open_clientfd(char *hostname, int portno);
 int open_clientfd_r(char *hostname, int portno);
+int resolve_host_r(char *hostname, int portno, struct addrinfo **addlist);
+int connect_addrinfo(struct addrinfo *addlist);
 int open_listenfd(int portno);
+int open_local_listenfd(int portno);
+int open_reuseport_listenfd(int portno);
 
 /* Wrappers for client/server helper functions */
 int Open_clientfd(char *hostname, int port);
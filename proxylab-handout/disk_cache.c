@@ -0,0 +1,523 @@
+/* disk cache
+ * the second tier behind the memory cache
+ * blocks evicted from the memory cache are appended to a log file,
+ * which is used as a ring: when the end of the file (capacity) is
+ * reached, writing restarts at offset 0 and overwrites the oldest records
+ * an in-memory hash index maps ids to records, and a list in log order
+ * tells which records are overwritten by the next append
+ *
+ * every record carries a small header with a checksum, so that the index
+ * can be rebuilt by scanning the log when the proxy restarts; a record
+ * torn by a crash, or partly overwritten by a wrapped log, fails the
+ * checksum, and the scan goes on at the next page
+ * hits are sent straight from the file to the client with sendfile
+ *
+ * a record is written outside the mutex: its place in the log is
+ * reserved first, and it is indexed once it is on disk
+ * sendfile leaves the file's pages in the socket buffer until the client
+ * reads them, so a record is not written over those pages: records start
+ * on a page, and the pages of a record's place are punched out of the
+ * file first, which leaves the old ones to the sockets
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <zlib.h>
+#include "csapp.h"
+#include "cache.h"
+#include "disk_cache.h"
+#include "http.h"
+#include "range.h"
+#include "metrics.h"
+#include "log.h"
+
+//=========================================functions
+/* disk_cache_lookup
+ * returns the newest entry for id, or NULL
+ * the caller must hold Disk->mutex
+ */
+static DE *disk_cache_lookup (DC *Disk, char *id) {
+    DE *ptr = Disk->buckets[cache_hash(id) % DISK_CACHE_BUCKETS];
+    while (ptr) {
+        if (!strcmp(id, ptr->id)) {
+            return ptr;
+        }
+        ptr = ptr->hnext;
+    }
+    return NULL;
+}
+
+/* disk_cache_unlink_hash
+ * removes an entry from its hash chain, if it is still there
+ */
+static void disk_cache_unlink_hash (DC *Disk, DE *entry) {
+    DE **pp = &Disk->buckets[cache_hash(entry->id) % DISK_CACHE_BUCKETS];
+    while (*pp && *pp != entry) {
+        pp = &(*pp)->hnext;
+    }
+    if (*pp) {
+        *pp = entry->hnext;
+    }
+}
+
+/* disk_cache_drop_oldest
+ * forgets the oldest record in the log
+ */
+static void disk_cache_drop_oldest (DC *Disk) {
+    DE *entry = Disk->log_head;
+    Disk->log_head = entry->lnext;
+    if (Disk->log_head == NULL) {
+        Disk->log_tail = NULL;
+    }
+    disk_cache_unlink_hash(Disk, entry);
+    Disk->entry_cnt--;
+    Free(entry->id);
+    Free(entry);
+}
+
+/* disk_cache_link_hash
+ * makes an entry the one found for its id
+ * an older entry of the same id is shadowed, unless a client is still
+ * reading it; it stays in the log until overwritten
+ */
+static void disk_cache_link_hash (DC *Disk, DE *entry) {
+    unsigned bucket = cache_hash(entry->id) % DISK_CACHE_BUCKETS;
+    DE *old = disk_cache_lookup(Disk, entry->id);
+    if (old && old->refcnt == 0) {
+        disk_cache_unlink_hash(Disk, old);
+    }
+    entry->hnext = Disk->buckets[bucket];
+    Disk->buckets[bucket] = entry;
+}
+
+/* disk_cache_add_entry
+ * puts a record in the log as the newest one, without indexing it
+ * returns the new entry
+ */
+static DE *disk_cache_add_entry (DC *Disk, char *id, off_t offset,
+                                 unsigned len, unsigned size, unsigned seq) {
+    DE *entry = Malloc(sizeof(DE));
+    entry->id = Malloc(strlen(id) + 1);
+    strcpy(entry->id, id);
+    entry->offset = offset;
+    entry->len = len;
+    entry->size = size;
+    entry->seq = seq;
+    entry->refcnt = 0;
+    entry->hnext = NULL;
+    entry->lnext = NULL;
+    if (Disk->log_tail) {
+        Disk->log_tail->lnext = entry;
+    }
+    else {
+        Disk->log_head = entry;
+    }
+    Disk->log_tail = entry;
+    Disk->entry_cnt++;
+    return entry;
+}
+
+/* disk_cache_sum
+ * returns the checksum of a record's header, with sum 0, and id; the
+ * data is added to it with crc32
+ */
+static uLong disk_cache_sum (DR *hdr, char *id) {
+    DR zeroed = *hdr;
+    zeroed.sum = 0;
+    return crc32(crc32(0L, (const Bytef *)&zeroed, sizeof(DR)),
+                 (const Bytef *)id, hdr->id_len);
+}
+
+/* disk_cache_record_len
+ * returns the length of the place of a record, rounded up to a page
+ */
+static off_t disk_cache_record_len (unsigned id_len, unsigned size) {
+    off_t len = sizeof(DR) + (off_t)id_len + size;
+    return (len + DISK_CACHE_ALIGN - 1) / DISK_CACHE_ALIGN * DISK_CACHE_ALIGN;
+}
+
+/* a record found while scanning the log */
+typedef struct disk_found {
+    off_t offset;
+    unsigned len;
+    unsigned size;
+    unsigned seq;
+    char *id;
+} DF;
+
+static int disk_found_cmp (const void *a, const void *b) {
+    unsigned sa = ((const DF *)a)->seq, sb = ((const DF *)b)->seq;
+    return (sa > sb) - (sa < sb);
+}
+
+/* the ring position of a record found: how far past the tail it is */
+static off_t disk_found_tail, disk_found_capacity;
+
+static int disk_found_ring_cmp (const void *a, const void *b) {
+    off_t oa = ((const DF *)a)->offset, ob = ((const DF *)b)->offset;
+    oa += (oa < disk_found_tail) ? disk_found_capacity : 0;
+    ob += (ob < disk_found_tail) ? disk_found_capacity : 0;
+    return (oa > ob) - (oa < ob);
+}
+
+/* disk_cache_check_record
+ * reads the record at offset, if there is a whole one, whose checksum
+ * matches, and fills in found
+ * returns 0 if the record is good, -1 if not
+ */
+static int disk_cache_check_record (DC *Disk, off_t offset, off_t end,
+                                    char *buf, DF *found) {
+    DR hdr;
+    char *id;
+    uLong sum;
+    unsigned done, n;
+
+    if (pread(Disk->fd, &hdr, sizeof(DR), offset) != sizeof(DR) ||
+            hdr.magic != DISK_CACHE_MAGIC || hdr.id_len == 0 ||
+            hdr.id_len > MAXLINE || hdr.size > Disk->capacity) {
+        return -1;
+    }
+    off_t len = disk_cache_record_len(hdr.id_len, hdr.size);
+    if (offset + (off_t)(sizeof(DR) + hdr.id_len + hdr.size) > end ||
+            len > Disk->capacity) {
+        return -1;
+    }
+    id = Malloc(hdr.id_len + 1);
+    if (pread(Disk->fd, id, hdr.id_len, offset + sizeof(DR))
+            != hdr.id_len) {
+        Free(id);
+        return -1;
+    }
+    id[hdr.id_len] = '\0';
+    /* the data is summed a buffer at a time */
+    sum = disk_cache_sum(&hdr, id);
+    for (done = 0; done < hdr.size; done += n) {
+        n = hdr.size - done;
+        n = (n < DISK_CACHE_SCAN) ? n : DISK_CACHE_SCAN;
+        if (pread(Disk->fd, buf, n, offset + sizeof(DR) + hdr.id_len + done)
+                != n) {
+            Free(id);
+            return -1;
+        }
+        sum = crc32(sum, (const Bytef *)buf, n);
+    }
+    if (sum != hdr.sum) {
+        Free(id);
+        return -1;
+    }
+    found->offset = offset;
+    found->len = len;
+    found->size = hdr.size;
+    found->seq = hdr.seq;
+    found->id = id;
+    return 0;
+}
+
+/* disk_cache_recover
+ * rebuilds the index from the records left by a previous run
+ * the whole file is scanned: a bad record is skipped by going on at the
+ * next page, so that the older records past the tail of a wrapped log
+ * are kept
+ * the newest record (by seq) gives the tail; the records are put in the
+ * log in ring order from the tail, which is the order in which appends
+ * overwrite them, and indexed newest first by id
+ */
+static void disk_cache_recover (DC *Disk) {
+    struct stat st;
+    off_t offset = 0, end;
+    DF *found = NULL;
+    unsigned found_cnt = 0, found_max = 0, skipped = 0, i;
+    char *buf;
+
+    if (fstat(Disk->fd, &st) < 0) {
+        return;
+    }
+    end = (st.st_size < Disk->capacity) ? st.st_size : Disk->capacity;
+    buf = Malloc(DISK_CACHE_SCAN);
+    while (offset + (off_t)sizeof(DR) <= end) {
+        if (found_cnt == found_max) {
+            found_max = found_max ? 2 * found_max : 64;
+            found = Realloc(found, found_max * sizeof(DF));
+        }
+        if (disk_cache_check_record(Disk, offset, end, buf,
+                                    &found[found_cnt]) < 0) {
+            offset += DISK_CACHE_ALIGN;
+            skipped++;
+            continue;
+        }
+        offset += found[found_cnt].len;
+        found_cnt++;
+    }
+    Free(buf);
+
+    if (found_cnt > 0) {
+        /* the newest record ends where the next one is appended */
+        qsort(found, found_cnt, sizeof(DF), disk_found_cmp);
+        Disk->seq = found[found_cnt - 1].seq + 1;
+        Disk->tail = found[found_cnt - 1].offset + found[found_cnt - 1].len;
+        disk_found_tail = Disk->tail;
+        disk_found_capacity = Disk->capacity;
+        qsort(found, found_cnt, sizeof(DF), disk_found_ring_cmp);
+    }
+    for (i = 0; i < found_cnt; i++) {
+        DE *entry = disk_cache_add_entry(Disk, found[i].id, found[i].offset,
+                                         found[i].len, found[i].size,
+                                         found[i].seq);
+        DE *newer = disk_cache_lookup(Disk, found[i].id);
+        if (newer == NULL || newer->seq < entry->seq) {
+            disk_cache_link_hash(Disk, entry);
+        }
+        Free(found[i].id);
+    }
+    if (found) {
+        Free(found);
+    }
+    log_info("disk cache: recovered %u records, skipped %u pages\n",
+             Disk->entry_cnt, skipped);
+}
+
+/* disk_cache_open
+ * opens (or creates) the log file at path, which never grows
+ * beyond capacity bytes, and rebuilds its index
+ * returns NULL if the file cannot be opened
+ */
+DC *disk_cache_open (char *path, off_t capacity) {
+    int fd;
+    if ((fd = open(path, O_RDWR | O_CREAT,
+                   S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) < 0) {
+        return NULL;
+    }
+    DC *Disk = Calloc(1, sizeof(DC));
+    Disk->fd = fd;
+    Disk->capacity = capacity;
+    Disk->tail = 0;
+    Disk->seq = 0;
+    sem_init(&Disk->mutex, 0, 1);
+    disk_cache_recover(Disk);
+    return Disk;
+}
+
+/* disk_cache_make_room
+ * forgets the records overlapped by an append of len bytes at Disk->tail,
+ * wrapping to the start of the file when the end is reached
+ * the oldest record is ahead of the tail once it ends past it; records
+ * differ in length, so it may start a little before it
+ * returns -1 if a record to be overwritten is being sent to a client
+ * the caller must hold Disk->mutex
+ */
+static int disk_cache_make_room (DC *Disk, unsigned len) {
+    if (Disk->tail + len > Disk->capacity) {
+        /* the records left ahead of the tail are the oldest ones */
+        while (Disk->log_head &&
+               Disk->log_head->offset + Disk->log_head->len > Disk->tail) {
+            if (Disk->log_head->refcnt) {
+                return -1;
+            }
+            disk_cache_drop_oldest(Disk);
+        }
+        Disk->tail = 0;
+    }
+    while (Disk->log_head &&
+           Disk->log_head->offset + Disk->log_head->len > Disk->tail &&
+           Disk->log_head->offset < Disk->tail + len) {
+        if (Disk->log_head->refcnt) {
+            return -1;
+        }
+        disk_cache_drop_oldest(Disk);
+    }
+    return 0;
+}
+
+/* disk_cache_put
+ * appends a block to the log and indexes it
+ * the record's place is reserved under the mutex, and held by refcnt
+ * while it is written outside it, so that lookups and serves do not
+ * wait for the write; the record is indexed once written
+ * returns 0 on success, -1 if the block was not stored
+ */
+int disk_cache_put (DC *Disk, char *id, char *data, unsigned size) {
+    DR hdr;
+    DE *entry;
+    struct iovec iov[3];
+    unsigned id_len = strlen(id);
+    off_t len = disk_cache_record_len(id_len, size);
+    int rc;
+
+    if (len > Disk->capacity) {
+        return -1;
+    }
+    P(&Disk->mutex);
+    if (disk_cache_make_room(Disk, len) < 0) {
+        V(&Disk->mutex);
+        return -1;
+    }
+    hdr.magic = DISK_CACHE_MAGIC;
+    hdr.id_len = id_len;
+    hdr.size = size;
+    hdr.seq = Disk->seq++;
+    entry = disk_cache_add_entry(Disk, id, Disk->tail, len, size, hdr.seq);
+    entry->refcnt = 1;
+    Disk->tail += len;
+    V(&Disk->mutex);
+
+    /* sockets still sending the old pages keep them, see above; a file
+     * system that cannot punch holes is written over in place */
+    fallocate(Disk->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              entry->offset, len);
+    hdr.sum = crc32(disk_cache_sum(&hdr, id), (const Bytef *)data, size);
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(DR);
+    iov[1].iov_base = id;
+    iov[1].iov_len = id_len;
+    iov[2].iov_base = data;
+    iov[2].iov_len = size;
+    rc = (pwritev(Disk->fd, iov, 3, entry->offset) ==
+          (ssize_t)(sizeof(DR) + id_len + size)) ? 0 : -1;
+
+    /* a failed write stays in the log, unindexed, until overwritten;
+     * so does a write that a newer one of the same id overtook */
+    P(&Disk->mutex);
+    entry->refcnt--;
+    DE *newer = disk_cache_lookup(Disk, id);
+    if (rc == 0 && (newer == NULL || newer->seq < entry->seq)) {
+        disk_cache_link_hash(Disk, entry);
+    }
+    V(&Disk->mutex);
+    return rc;
+}
+
+/* disk_cache_sendfile
+ * sends n bytes of the log file at offset to fd
+ * returns 0 on success, -1 on error
+ */
+static int disk_cache_sendfile (DC *Disk, int fd, off_t offset, size_t n) {
+    while (n > 0) {
+        ssize_t sent = sendfile(fd, Disk->fd, &offset, n);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        /* a coroutine's non-blocking socket, see coro.c */
+        if (sent < 0 && errno == EAGAIN && rio_wait_fd(fd, POLLOUT) == 0) {
+            continue;
+        }
+        if (sent <= 0) {
+            return -1;
+        }
+        metrics_add(M_BYTES_SERVED, sent);
+        n -= sent;
+    }
+    return 0;
+}
+
+/* disk_cache_send_range
+ * sends the requested range of a response stored at offset
+ * only the headers are read into memory; the body slice is sent
+ * with sendfile, and responses other than 200 are sent whole
+ */
+static int disk_cache_send_range (DC *Disk, int fd, off_t offset,
+                                  size_t size, BR *range) {
+    char resp_hdrs[MAXBUF], hdr_buf[2 * MAXBUF];
+    size_t n = (size < MAXBUF) ? size : MAXBUF;
+    size_t hdr_size, start, end;
+
+    if (pread(Disk->fd, resp_hdrs, n, offset) != n) {
+        return -1;
+    }
+    hdr_size = http_header_end(resp_hdrs, n);
+    if (hdr_size == 0 || http_status(resp_hdrs, hdr_size) != 200) {
+        return disk_cache_sendfile(Disk, fd, offset, size);
+    }
+    if (range_resolve(range, size - hdr_size, &start, &end) < 0) {
+        n = range_unsatisfiable(size - hdr_size, hdr_buf);
+        if (rio_writen(fd, hdr_buf, n) < 0) {
+            return -1;
+        }
+        metrics_add(M_BYTES_SERVED, n);
+        return 0;
+    }
+    n = range_headers(resp_hdrs, hdr_size, start, end, size - hdr_size,
+                      hdr_buf, sizeof(hdr_buf));
+    if (n == 0) {
+        return disk_cache_sendfile(Disk, fd, offset, size);
+    }
+    if (rio_writen(fd, hdr_buf, n) < 0) {
+        return -1;
+    }
+    metrics_add(M_BYTES_SERVED, n);
+    return disk_cache_sendfile(Disk, fd, offset + hdr_size + start,
+                               end - start + 1);
+}
+
+/* disk_cache_serve
+ * sends the data stored for id to fd without copying it to user space
+ * if range is not NULL, only the requested bytes of the body are sent
+ * returns 1 if served, 0 if id is not on disk, -1 on a write error
+ */
+int disk_cache_serve (DC *Disk, char *id, int fd, BR *range) {
+    P(&Disk->mutex);
+    DE *entry = disk_cache_lookup(Disk, id);
+    if (entry == NULL) {
+        V(&Disk->mutex);
+        return 0;
+    }
+    entry->refcnt++;
+    V(&Disk->mutex);
+
+    off_t offset = entry->offset + sizeof(DR) + strlen(id);
+    int rc;
+    log_debug("Disk cache hit\n");
+    metrics_add(M_DISK_HITS, 1);
+    if (range) {
+        rc = disk_cache_send_range(Disk, fd, offset, entry->size, range);
+    }
+    else {
+        rc = disk_cache_sendfile(Disk, fd, offset, entry->size);
+    }
+
+    P(&Disk->mutex);
+    entry->refcnt--;
+    V(&Disk->mutex);
+    return (rc < 0) ? -1 : 1;
+}
+
+/* disk_cache_serve_head
+ * sends only the headers stored for id to fd, for a HEAD request
+ * returns 1 if served, 0 if id is not on disk (or its headers do not
+ * fit in MAXBUF), -1 on a write error
+ */
+int disk_cache_serve_head (DC *Disk, char *id, int fd) {
+    char resp_hdrs[MAXBUF];
+    P(&Disk->mutex);
+    DE *entry = disk_cache_lookup(Disk, id);
+    if (entry == NULL) {
+        V(&Disk->mutex);
+        return 0;
+    }
+    entry->refcnt++;
+    V(&Disk->mutex);
+
+    off_t offset = entry->offset + sizeof(DR) + strlen(id);
+    size_t n = (entry->size < MAXBUF) ? entry->size : MAXBUF;
+    size_t hdr_size = 0;
+    int rc = 0;
+    if (pread(Disk->fd, resp_hdrs, n, offset) == n &&
+            (hdr_size = http_header_end(resp_hdrs, n)) > 0) {
+        log_debug("Disk cache hit\n");
+        metrics_add(M_DISK_HITS, 1);
+        rc = (rio_writen(fd, resp_hdrs, hdr_size) < 0) ? -1 : 1;
+        if (rc > 0) {
+            metrics_add(M_BYTES_SERVED, hdr_size);
+        }
+    }
+
+    P(&Disk->mutex);
+    entry->refcnt--;
+    V(&Disk->mutex);
+    return rc;
+}
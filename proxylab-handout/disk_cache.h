@@ -0,0 +1,56 @@
+/* This header file contains the interfaces to the disk cache,
+ * the second tier behind the memory cache in cache.c
+ */
+#ifndef __DISK_CACHE_H__
+#define __DISK_CACHE_H__
+
+#include "csapp.h"
+#include "range.h"
+
+#define DISK_CACHE_SIZE (256L * 1024 * 1024)
+#define DISK_CACHE_BUCKETS 4096
+#define DISK_CACHE_MAGIC 0x50584432 /* "PXD2", records with a checksum */
+#define DISK_CACHE_ALIGN 4096   /* records start on a page boundary */
+#define DISK_CACHE_SCAN 65536   /* bytes read at once by recovery */
+
+/* on-disk record header, followed by the id and the data */
+typedef struct disk_record {
+    unsigned magic;
+    unsigned id_len;
+    unsigned size;
+    unsigned seq;
+    unsigned sum;               /* crc32 of the header, id and data */
+} DR;
+
+typedef struct disk_entry {
+    struct disk_entry *hnext;   /* next entry in the hash chain */
+    struct disk_entry *lnext;   /* next (newer) entry in the log */
+    char *id;
+    off_t offset;               /* offset of the record header */
+    unsigned len;               /* length of the record, page aligned */
+    unsigned size;              /* length of the data */
+    unsigned seq;
+    int refcnt;                 /* readers sending it, or its writer */
+} DE;
+
+typedef struct disk_cache {
+    int fd;
+    off_t capacity;
+    off_t tail;                 /* where the next record is appended */
+    unsigned seq;
+    DE *log_head;               /* oldest entry */
+    DE *log_tail;               /* newest entry */
+    DE *buckets[DISK_CACHE_BUCKETS];
+    unsigned entry_cnt;
+    sem_t mutex;
+} DC;
+
+DC *disk_cache_open (char *path, off_t capacity);
+
+int disk_cache_put (DC *Disk, char *id, char *data, unsigned size);
+
+int disk_cache_serve (DC *Disk, char *id, int fd, BR *range);
+
+int disk_cache_serve_head (DC *Disk, char *id, int fd);
+
+#endif /* __DISK_CACHE_H__ */
@@ -0,0 +1,126 @@
+/* fqueue
+ * a bounded queue of accepted connections, like the sbuf of CSAPP
+ * figure 12.24, that hands them to the workers fairly: every client
+ * with connections waiting has a queue of its own, and the workers
+ * take one connection from each client in turn, so a client sending
+ * many requests at once only delays its own
+ * a client may not have more than client_max connections waiting
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include "csapp.h"
+#include "fqueue.h"
+
+//=========================================functions
+/* fq_create
+ * returns an empty queue holding up to size connections
+ */
+FQ *fq_create (unsigned size, unsigned client_max) {
+    FQ *queue = Calloc(1, sizeof(FQ));
+    queue->client_max = client_max;
+    Sem_init(&queue->mutex, 0, 1);
+    Sem_init(&queue->slots, 0, size);
+    Sem_init(&queue->items, 0, 0);
+    return queue;
+}
+
+static FCL **fq_bucket (FQ *queue, unsigned addr) {
+    return &queue->buckets[(addr * 0x9e3779b1U) >> 24 & (FQ_BUCKETS - 1)];
+}
+
+/* fq_append_round
+ * puts a client at the end of the round
+ * the caller must hold queue->mutex
+ */
+static void fq_append_round (FQ *queue, FCL *client) {
+    client->anext = NULL;
+    if (queue->round_tail) {
+        queue->round_tail->anext = client;
+    }
+    else {
+        queue->round_head = client;
+    }
+    queue->round_tail = client;
+}
+
+/* fq_insert
+ * queues a connection from the client at addr, waiting for a free
+ * place if the queue is full
+ * returns 0, or -1 if the client already has client_max waiting
+ */
+int fq_insert (FQ *queue, int fd, unsigned addr) {
+    FCL **bucket = fq_bucket(queue, addr), *client;
+    P(&queue->slots);
+    P(&queue->mutex);
+    for (client = *bucket; client; client = client->hnext) {
+        if (client->addr == addr) {
+            break;
+        }
+    }
+    if (client && client->cnt >= queue->client_max) {
+        V(&queue->mutex);
+        V(&queue->slots);
+        return -1;
+    }
+    if (client == NULL) {
+        client = Calloc(1, sizeof(FCL));
+        client->addr = addr;
+        client->hnext = *bucket;
+        *bucket = client;
+        fq_append_round(queue, client);
+    }
+    FCN *conn = Malloc(sizeof(FCN));
+    conn->fd = fd;
+    conn->next = NULL;
+    if (client->tail) {
+        client->tail->next = conn;
+    }
+    else {
+        client->head = conn;
+    }
+    client->tail = conn;
+    client->cnt++;
+    V(&queue->mutex);
+    V(&queue->items);
+    return 0;
+}
+
+/* fq_remove
+ * waits for a connection and returns it, taking the oldest one of the
+ * next client in the round
+ */
+int fq_remove (FQ *queue) {
+    P(&queue->items);
+    P(&queue->mutex);
+    FCL *client = queue->round_head;
+    FCN *conn = client->head;
+    int fd = conn->fd;
+
+    queue->round_head = client->anext;
+    if (queue->round_head == NULL) {
+        queue->round_tail = NULL;
+    }
+    client->head = conn->next;
+    if (client->head == NULL) {
+        client->tail = NULL;
+    }
+    if (--client->cnt > 0) {
+        fq_append_round(queue, client);
+    }
+    else {
+        /* nothing left to wait for, forget the client */
+        FCL **pp = fq_bucket(queue, client->addr);
+        while (*pp != client) {
+            pp = &(*pp)->hnext;
+        }
+        *pp = client->hnext;
+        Free(client);
+    }
+    V(&queue->mutex);
+    V(&queue->slots);
+    Free(conn);
+    return fd;
+}
@@ -0,0 +1,44 @@
+/* This header file contains the interfaces to the fair connection queue
+ * between the accepting thread and the worker threads
+ */
+#ifndef __FQUEUE_H__
+#define __FQUEUE_H__
+
+#include "csapp.h"
+
+#define FQ_SIZE 1024            /* connections waiting for a worker */
+#define FQ_CLIENT_MAX 64        /* of which from one client */
+#define FQ_BUCKETS 256          /* a power of 2 */
+
+typedef struct fq_conn {
+    struct fq_conn *next;
+    int fd;
+} FCN;
+
+/* the connections of one client, while it has some waiting */
+typedef struct fq_client {
+    struct fq_client *hnext;    /* next client in the hash chain */
+    struct fq_client *anext;    /* next client in the round */
+    unsigned addr;
+    unsigned cnt;
+    FCN *head;
+    FCN *tail;
+} FCL;
+
+typedef struct fair_queue {
+    FCL *buckets[FQ_BUCKETS];
+    FCL *round_head;            /* the client served next */
+    FCL *round_tail;
+    unsigned client_max;
+    sem_t mutex;                /* protects the queue */
+    sem_t slots;                /* counts free places */
+    sem_t items;                /* counts waiting connections */
+} FQ;
+
+FQ *fq_create (unsigned size, unsigned client_max);
+
+int fq_insert (FQ *queue, int fd, unsigned addr);
+
+int fq_remove (FQ *queue);
+
+#endif /* __FQUEUE_H__ */
@@ -0,0 +1,149 @@
+/* head
+ * a cached block knows the length of its headers (hdr_size), so some
+ * requests are answered from the headers alone:
+ * a HEAD request gets the headers of the cached GET response, and a
+ * conditional request (If-None-Match, If-Modified-Since) whose
+ * validators still match the cached response gets a 304, without the
+ * body that the client already has
+ *
+ * a HEAD that misses is sent on to the server, and the response is
+ * cached as a header-only entry under HEAD_KEY_PREFIX and the key,
+ * which GET requests never look up
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#define _GNU_SOURCE
+#include <time.h>
+#include "csapp.h"
+#include "cache.h"
+#include "head.h"
+#include "http.h"
+
+/* the headers of the cached response that a 304 repeats */
+static const char *not_modified_hdrs[] = {
+    "Date", "ETag", "Last-Modified", "Cache-Control", "Expires",
+    "Content-Location", "Vary", NULL
+};
+
+//=========================================functions
+/* head_headers
+ * returns the headers of a block as a client that accepts gzip, or
+ * not, gets them, and sets size to their length
+ */
+static char *head_headers (CB *blk, int accept_gzip, size_t *size) {
+    if (blk->encoding == CB_GZIP && accept_gzip) {
+        *size = blk->gzip_hdr_size;
+        return blk->data + blk->hdr_size + blk->body_size;
+    }
+    *size = blk->hdr_size ? blk->hdr_size : blk->size;
+    return blk->data;
+}
+
+/* head_date
+ * returns the time of an HTTP date ("Sun, 06 Nov 1994 08:49:37 GMT"),
+ * or -1 if it cannot be parsed
+ */
+static time_t head_date (const char *value) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm) == NULL) {
+        return -1;
+    }
+    return timegm(&tm);
+}
+
+/* head_etag_match
+ * checks if the If-None-Match list names etag, or is "*"
+ * weak and strong tags compare the same, as RFC 7232 asks for here
+ */
+static int head_etag_match (const char *list, const char *etag) {
+    size_t etag_len;
+    if (!strncmp(etag, "W/", 2)) {
+        etag += 2;
+    }
+    etag_len = strlen(etag);
+    while (*list) {
+        while (*list == ' ' || *list == ',') {
+            list++;
+        }
+        const char *next = list + strcspn(list, ",");
+        size_t len = next - list;
+        while (len > 0 && list[len - 1] == ' ') {
+            len--;
+        }
+        if (len == 1 && *list == '*') {
+            return 1;
+        }
+        if (len >= 2 && !strncmp(list, "W/", 2)) {
+            list += 2;
+            len -= 2;
+        }
+        if (len > 0 && len == etag_len && !strncmp(list, etag, len)) {
+            return 1;
+        }
+        list = next;
+    }
+    return 0;
+}
+
+/* head_not_modified
+ * checks if a request with the headers client_hdrs is conditional,
+ * and its validators match the cached 200 response blk, so that a 304
+ * answers it; If-Modified-Since is only looked at without If-None-Match
+ */
+int head_not_modified (char *client_hdrs, CB *blk) {
+    char cond[MAXLINE], value[MAXLINE];
+    size_t len = strlen(client_hdrs);
+
+    if (blk->hdr_size == 0 || http_status(blk->data, blk->hdr_size) != 200) {
+        return 0;
+    }
+    if (http_header_value(client_hdrs, len, "If-None-Match", cond, MAXLINE)) {
+        if (!http_header_value(blk->data, blk->hdr_size, "ETag",
+                               value, MAXLINE)) {
+            return !strcmp(cond, "*");
+        }
+        return head_etag_match(cond, value);
+    }
+    if (http_header_value(client_hdrs, len, "If-Modified-Since",
+                          cond, MAXLINE) &&
+            http_header_value(blk->data, blk->hdr_size, "Last-Modified",
+                              value, MAXLINE)) {
+        time_t since = head_date(cond), modified = head_date(value);
+        return since >= 0 && modified >= 0 && modified <= since &&
+               since <= time(NULL);
+    }
+    return 0;
+}
+
+/* head_serve
+ * sends the headers of a block to fd, for a HEAD request, or a 304
+ * built from them if not_modified is set
+ * returns the number of bytes sent, -1 on error
+ */
+ssize_t head_serve (CB *blk, int fd, int accept_gzip, int not_modified) {
+    char buf[MAXBUF], value[MAXLINE];
+    size_t size, n;
+    char *hdrs = head_headers(blk, accept_gzip, &size);
+    int i;
+
+    if (!not_modified) {
+        return rio_writen(fd, hdrs, size) < 0 ? -1 : size;
+    }
+    n = sprintf(buf, "HTTP/1.0 304 Not Modified\r\n");
+    for (i = 0; not_modified_hdrs[i]; i++) {
+        /* a header that does not fit, with the blank line, is left out */
+        if (http_header_value(hdrs, size, not_modified_hdrs[i],
+                              value, MAXLINE)) {
+            size_t len = snprintf(buf + n, MAXBUF - 2 - n, "%s: %s\r\n",
+                                  not_modified_hdrs[i], value);
+            n += (len < MAXBUF - 2 - n) ? len : 0;
+        }
+    }
+    memcpy(buf + n, "\r\n", 2);
+    n += 2;
+    return rio_writen(fd, buf, n) < 0 ? -1 : n;
+}
@@ -0,0 +1,16 @@
+/* This header file contains the interfaces to the responses sent from
+ * the headers of a cached object alone: HEAD requests and 304s
+ */
+#ifndef __HEAD_H__
+#define __HEAD_H__
+
+#include "csapp.h"
+#include "cache.h"
+
+#define HEAD_KEY_PREFIX "HEAD " /* of the keys of header-only entries */
+
+int head_not_modified (char *client_hdrs, CB *blk);
+
+ssize_t head_serve (CB *blk, int fd, int accept_gzip, int not_modified);
+
+#endif /* __HEAD_H__ */
@@ -0,0 +1,100 @@
+/* hist
+ * HDR (high dynamic range) histograms of latencies
+ * values below 2^HIST_SUB_BITS get a bucket each; above, every power
+ * of 2 is split into HIST_HALF buckets, so a bucket is never wider
+ * than 1/HIST_HALF of the values it holds, from microseconds to hours
+ * recording is one relaxed atomic add; readers copy the counts into
+ * a snapshot and compute percentiles from it
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include "csapp.h"
+#include "hist.h"
+
+//=========================================functions
+/* hist_index
+ * returns the bucket of a value
+ */
+static unsigned hist_index (unsigned long value) {
+    if (value >= (1UL << HIST_MAX_BITS)) {
+        value = (1UL << HIST_MAX_BITS) - 1;
+    }
+    if (value < HIST_SUB_COUNT) {
+        return value;
+    }
+    unsigned msb = 63 - __builtin_clzl(value);
+    unsigned shift = msb - (HIST_SUB_BITS - 1);
+    return HIST_SUB_COUNT + (shift - 1) * HIST_HALF +
+           ((value >> shift) - HIST_HALF);
+}
+
+/* hist_value
+ * returns the highest value that falls in a bucket
+ */
+static unsigned long hist_value (unsigned index) {
+    if (index < HIST_SUB_COUNT) {
+        return index;
+    }
+    unsigned shift = (index - HIST_SUB_COUNT) / HIST_HALF + 1;
+    unsigned long top = (index - HIST_SUB_COUNT) % HIST_HALF + HIST_HALF;
+    return ((top + 1) << shift) - 1;
+}
+
+/* hist_record
+ * counts one value
+ */
+void hist_record (HH *hist, unsigned long value) {
+    atomic_fetch_add_explicit(&hist->count[hist_index(value)], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->sum, value, memory_order_relaxed);
+}
+
+/* hist_add
+ * adds the counts of a histogram to a snapshot
+ */
+void hist_add (HS *snap, HH *hist) {
+    unsigned i;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        unsigned long n = atomic_load_explicit(&hist->count[i],
+                                               memory_order_relaxed);
+        snap->count[i] += n;
+        snap->total += n;
+    }
+    snap->sum += atomic_load_explicit(&hist->sum, memory_order_relaxed);
+}
+
+/* hist_percentile
+ * returns the value below which percentile % of the values fall,
+ * or 0 if the snapshot is empty
+ */
+unsigned long hist_percentile (HS *snap, double percentile) {
+    unsigned long rank = (unsigned long)(snap->total * percentile / 100.0);
+    unsigned long seen = 0;
+    unsigned i;
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += snap->count[i];
+        if (seen >= rank) {
+            return hist_value(i);
+        }
+    }
+    return 0;
+}
+
+/* hist_max
+ * returns the largest value recorded, or 0 if the snapshot is empty
+ */
+unsigned long hist_max (HS *snap) {
+    unsigned i = HIST_BUCKETS;
+    while (i-- > 0) {
+        if (snap->count[i]) {
+            return hist_value(i);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+/* This header file contains the interfaces to the HDR latency histograms
+ */
+#ifndef __HIST_H__
+#define __HIST_H__
+
+#include <stdatomic.h>
+#include "csapp.h"
+
+/* values are microseconds, recorded with about 1% precision
+ * (2^HIST_SUB_BITS sub-buckets per power of 2) up to 2^HIST_MAX_BITS
+ */
+#define HIST_SUB_BITS 7
+#define HIST_MAX_BITS 32
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_HALF (HIST_SUB_COUNT / 2)
+#define HIST_BUCKETS \
+    (HIST_SUB_COUNT + (HIST_MAX_BITS - HIST_SUB_BITS) * HIST_HALF)
+
+/* a histogram that threads record into */
+typedef struct hist {
+    atomic_ulong count[HIST_BUCKETS];
+    atomic_ulong sum;
+} HH;
+
+/* a plain copy of one or more histograms, for reading */
+typedef struct hist_snapshot {
+    unsigned long count[HIST_BUCKETS];
+    unsigned long total;
+    unsigned long sum;
+} HS;
+
+void hist_record (HH *hist, unsigned long value);
+
+void hist_add (HS *snap, HH *hist);
+
+unsigned long hist_percentile (HS *snap, double percentile);
+
+unsigned long hist_max (HS *snap);
+
+#endif /* __HIST_H__ */
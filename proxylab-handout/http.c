@@ -0,0 +1,184 @@
+/* http
+ * small helpers to pick apart HTTP messages
+ * a header block is a run of "Name: value\r\n" lines, either a stored
+ * response (status line, headers and blank line) or the request headers
+ * kept by doit; names are compared case-insensitively
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include "csapp.h"
+#include "http.h"
+
+//=========================================functions
+/* http_header_end
+ * returns the length of the header part of a message, including the
+ * blank line that ends it, or 0 if the headers are not complete
+ */
+size_t http_header_end (const char *data, size_t size) {
+    size_t i;
+    for (i = 0; i + 3 < size; i++) {
+        if (data[i] == '\r' && data[i+1] == '\n' &&
+                data[i+2] == '\r' && data[i+3] == '\n') {
+            return i + 4;
+        }
+    }
+    return 0;
+}
+
+/* http_status
+ * returns the status code of a response, or -1 if it has none
+ */
+int http_status (const char *data, size_t size) {
+    int status;
+    if (size < 12 || strncmp(data, "HTTP/", 5)) {
+        return -1;
+    }
+    const char *ptr = memchr(data, ' ', size);
+    if (ptr == NULL || sscanf(ptr, " %3d", &status) != 1) {
+        return -1;
+    }
+    return status;
+}
+
+/* http_header_value
+ * finds the header called name in a header block of len bytes
+ * and copies its value (without surrounding spaces) into value
+ * returns 1 if found, 0 otherwise
+ */
+int http_header_value (const char *hdrs, size_t len, const char *name,
+                       char *value, size_t max) {
+    size_t name_len = strlen(name);
+    const char *line = hdrs, *end = hdrs + len;
+
+    while (line < end) {
+        const char *eol = memchr(line, '\n', end - line);
+        if (eol == NULL) {
+            eol = end;
+        }
+        if (eol - line > name_len && line[name_len] == ':' &&
+                !strncasecmp(line, name, name_len)) {
+            const char *v = line + name_len + 1;
+            const char *v_end = eol;
+            while (v < v_end && (*v == ' ' || *v == '\t')) {
+                v++;
+            }
+            while (v_end > v && isspace((unsigned char)v_end[-1])) {
+                v_end--;
+            }
+            size_t n = v_end - v;
+            if (n >= max) {
+                n = max - 1;
+            }
+            memcpy(value, v, n);
+            value[n] = '\0';
+            return 1;
+        }
+        line = eol + 1;
+    }
+    return 0;
+}
+
+/* http_token_match
+ * checks if a comma separated header value such as
+ * "gzip, deflate;q=0.5" lists token with a non-zero quality
+ */
+int http_token_match (const char *list, const char *token) {
+    size_t token_len = strlen(token);
+    const char *ptr = list;
+
+    while (*ptr) {
+        while (*ptr == ' ' || *ptr == ',') {
+            ptr++;
+        }
+        const char *item_end = ptr + strcspn(ptr, ",");
+        if (!strncasecmp(ptr, token, token_len) &&
+                (ptr[token_len] == ',' || ptr[token_len] == ';' ||
+                 ptr[token_len] == ' ' || ptr[token_len] == '\0')) {
+            const char *q = strstr(ptr, "q=");
+            if (q == NULL || q > item_end || strtod(q + 2, NULL) > 0) {
+                return 1;
+            }
+        }
+        ptr = item_end;
+    }
+    return 0;
+}
+
+static int http_param_cmp (const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* http_normalize_uri
+ * turns a request uri into a cache key, so that equivalent spellings
+ * of a uri share one cache entry: the scheme and host are lowercased,
+ * the default port and the fragment are dropped, an empty path becomes
+ * "/", and with sort_query the query parameters are sorted
+ * returns 0 on success, -1 if the key does not fit in max bytes
+ */
+int http_normalize_uri (const char *uri, char *key, size_t max,
+                        int sort_query) {
+    char query[MAXLINE];
+    char *params[MAXLINE / 2];
+    const char *ptr = uri;
+    size_t n = 0;
+    int i, param_cnt = 0;
+
+    if (strlen(uri) + 9 > max || strlen(uri) >= MAXLINE) {
+        return -1;
+    }
+    if (!strncasecmp(ptr, "http://", 7)) {
+        ptr += 7;
+    }
+    strcpy(key, "http://");
+    n = 7;
+    //lowercase the host
+    while (*ptr && *ptr != ':' && *ptr != '/' && *ptr != '?' && *ptr != '#') {
+        key[n++] = tolower((unsigned char)*ptr++);
+    }
+    //keep the port unless it is the default one
+    if (*ptr == ':') {
+        const char *port = ++ptr;
+        while (isdigit((unsigned char)*ptr)) {
+            ptr++;
+        }
+        if (ptr > port && strtol(port, NULL, 10) != 80) {
+            n += sprintf(key + n, ":%ld", strtol(port, NULL, 10));
+        }
+    }
+    //path
+    if (*ptr != '/') {
+        key[n++] = '/';
+    }
+    while (*ptr && *ptr != '?' && *ptr != '#') {
+        key[n++] = *ptr++;
+    }
+    key[n] = '\0';
+    if (*ptr != '?') {
+        return 0;
+    }
+    //query, without the fragment
+    ptr++;
+    size_t query_len = strcspn(ptr, "#");
+    memcpy(query, ptr, query_len);
+    query[query_len] = '\0';
+    if (query_len == 0) {
+        return 0;
+    }
+    if (!sort_query) {
+        sprintf(key + n, "?%s", query);
+        return 0;
+    }
+    char *saveptr, *param = strtok_r(query, "&", &saveptr);
+    while (param) {
+        params[param_cnt++] = param;
+        param = strtok_r(NULL, "&", &saveptr);
+    }
+    qsort(params, param_cnt, sizeof(char *), http_param_cmp);
+    for (i = 0; i < param_cnt; i++) {
+        n += sprintf(key + n, "%c%s", i ? '&' : '?', params[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,21 @@
+/* This header file contains the small HTTP parsing helpers
+ * shared by proxy.c and the cache modules
+ */
+#ifndef __HTTP_H__
+#define __HTTP_H__
+
+#include "csapp.h"
+
+size_t http_header_end (const char *data, size_t size);
+
+int http_status (const char *data, size_t size);
+
+int http_header_value (const char *hdrs, size_t len, const char *name,
+                       char *value, size_t max);
+
+int http_token_match (const char *list, const char *token);
+
+int http_normalize_uri (const char *uri, char *key, size_t max,
+                        int sort_query);
+
+#endif /* __HTTP_H__ */
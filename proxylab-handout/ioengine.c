@@ -0,0 +1,288 @@
+/* ioengine
+ * asynchronous socket operations on io_uring, set up with the raw
+ * system calls so no library is needed
+ * operations are queued in the submission ring and handed to the kernel
+ * together by the next ioe_wait, which also waits for their results, so
+ * several operations cost one system call and run at the same time
+ *
+ * buffers registered with ioe_register_buffers are pinned by the kernel
+ * once, and operations on them skip mapping the pages on every call
+ * ioe_create returns NULL where io_uring is missing or not allowed
+ * (old kernels, seccomp), and the callers keep to blocking calls
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "csapp.h"
+#include "ioengine.h"
+
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define IOE_HAVE_URING 1
+#endif
+
+//=========================================functions
+#ifdef IOE_HAVE_URING
+/* ioe_create
+ * returns an engine for up to depth operations in flight,
+ * or NULL if io_uring cannot be used
+ */
+IOE *ioe_create (unsigned depth) {
+    struct io_uring_params p;
+    IOE *E;
+    int fd;
+
+    memset(&p, 0, sizeof(p));
+    if ((fd = syscall(__NR_io_uring_setup, depth, &p)) < 0) {
+        return NULL;
+    }
+    /* ioe_wait blocks with IORING_ENTER_EXT_ARG (Linux 5.11) */
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        close(fd);
+        return NULL;
+    }
+    E = Calloc(1, sizeof(IOE));
+    E->ring_fd = fd;
+    E->depth = p.sq_entries;
+    E->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    E->cq_ring_size = p.cq_off.cqes +
+                      p.cq_entries * sizeof(struct io_uring_cqe);
+    E->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (E->cq_ring_size > E->sq_ring_size) {
+            E->sq_ring_size = E->cq_ring_size;
+        }
+        E->cq_ring_size = 0;
+    }
+    E->sq_ring = mmap(NULL, E->sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (E->sq_ring == MAP_FAILED) {
+        goto err_ring;
+    }
+    if (E->cq_ring_size) {
+        E->cq_ring = mmap(NULL, E->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (E->cq_ring == MAP_FAILED) {
+            goto err_sq;
+        }
+    }
+    else {
+        E->cq_ring = E->sq_ring;
+    }
+    E->sqes = mmap(NULL, E->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (E->sqes == MAP_FAILED) {
+        goto err_cq;
+    }
+    E->sq_head = (unsigned *)((char *)E->sq_ring + p.sq_off.head);
+    E->sq_tail = (unsigned *)((char *)E->sq_ring + p.sq_off.tail);
+    E->sq_mask = (unsigned *)((char *)E->sq_ring + p.sq_off.ring_mask);
+    E->sq_array = (unsigned *)((char *)E->sq_ring + p.sq_off.array);
+    E->cq_head = (unsigned *)((char *)E->cq_ring + p.cq_off.head);
+    E->cq_tail = (unsigned *)((char *)E->cq_ring + p.cq_off.tail);
+    E->cq_mask = (unsigned *)((char *)E->cq_ring + p.cq_off.ring_mask);
+    E->cqes = (char *)E->cq_ring + p.cq_off.cqes;
+    return E;
+
+ err_cq:
+    if (E->cq_ring_size) {
+        munmap(E->cq_ring, E->cq_ring_size);
+    }
+ err_sq:
+    munmap(E->sq_ring, E->sq_ring_size);
+ err_ring:
+    close(fd);
+    Free(E);
+    return NULL;
+}
+
+/* ioe_destroy
+ * closes the engine; operations still in flight are cancelled by the
+ * kernel, which may complete them into their buffers while it does
+ */
+void ioe_destroy (IOE *E) {
+    munmap(E->sqes, E->sqes_size);
+    if (E->cq_ring_size) {
+        munmap(E->cq_ring, E->cq_ring_size);
+    }
+    munmap(E->sq_ring, E->sq_ring_size);
+    close(E->ring_fd);
+    Free(E);
+}
+
+/* ioe_register_buffers
+ * registers n buffers; receives and sends that fit in one of them
+ * use it as a fixed buffer
+ * returns 0 on success, -1 on error
+ */
+int ioe_register_buffers (IOE *E, struct iovec *iov, unsigned n) {
+    if (E->buffer_cnt || n > IOE_MAX_BUFFERS) {
+        return -1;
+    }
+    if (syscall(__NR_io_uring_register, E->ring_fd,
+                IORING_REGISTER_BUFFERS, iov, n) < 0) {
+        return -1;
+    }
+    memcpy(E->buffers, iov, n * sizeof(struct iovec));
+    E->buffer_cnt = n;
+    return 0;
+}
+
+/* ioe_buffer_index
+ * returns the registered buffer holding [buf, buf + len), or -1
+ */
+static int ioe_buffer_index (IOE *E, const void *buf, size_t len) {
+    unsigned i;
+    for (i = 0; i < E->buffer_cnt; i++) {
+        char *base = E->buffers[i].iov_base;
+        if ((char *)buf >= base &&
+                (char *)buf + len <= base + E->buffers[i].iov_len) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* ioe_get_sqe
+ * returns a cleared submission entry at the tail of the ring,
+ * or NULL if depth operations are already in flight
+ */
+static struct io_uring_sqe *ioe_get_sqe (IOE *E) {
+    if (E->inflight == E->depth) {
+        return NULL;
+    }
+    unsigned tail = *E->sq_tail;
+    unsigned index = tail & *E->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)E->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    E->sq_array[index] = index;
+    return sqe;
+}
+
+/* ioe_push_sqe
+ * makes the entry filled in after ioe_get_sqe visible to the kernel
+ */
+static void ioe_push_sqe (IOE *E) {
+    atomic_store_explicit((atomic_uint *)E->sq_tail, *E->sq_tail + 1,
+                          memory_order_release);
+    E->inflight++;
+    E->to_submit++;
+}
+
+/* ioe_rw
+ * queues a receive or a send, on a fixed buffer if buf is registered
+ */
+static int ioe_rw (IOE *E, int op, int fixed_op, int fd,
+                   const void *buf, size_t len, void *tag) {
+    struct io_uring_sqe *sqe = ioe_get_sqe(E);
+    if (sqe == NULL) {
+        return -1;
+    }
+    int index = ioe_buffer_index(E, buf, len);
+    if (index >= 0) {
+        sqe->opcode = fixed_op;
+        sqe->buf_index = index;
+    }
+    else {
+        sqe->opcode = op;
+    }
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    sqe->user_data = (unsigned long)tag;
+    ioe_push_sqe(E);
+    return 0;
+}
+
+/* ioe_recv
+ * queues a receive of up to len bytes from fd into buf
+ * returns 0, or -1 if the engine is full
+ */
+int ioe_recv (IOE *E, int fd, void *buf, size_t len, void *tag) {
+    return ioe_rw(E, IORING_OP_RECV, IORING_OP_READ_FIXED,
+                  fd, buf, len, tag);
+}
+
+/* ioe_send
+ * queues a send of len bytes from buf to fd
+ * like send(2), it may complete with fewer bytes
+ * returns 0, or -1 if the engine is full
+ */
+int ioe_send (IOE *E, int fd, const void *buf, size_t len, void *tag) {
+    return ioe_rw(E, IORING_OP_SEND, IORING_OP_WRITE_FIXED,
+                  fd, buf, len, tag);
+}
+
+/* ioe_wait
+ * submits the queued operations, waits until at least min of them
+ * have completed, and stores up to max completions in done
+ * returns the number of completions, or -1 on error
+ */
+int ioe_wait (IOE *E, IOC *done, int min, int max) {
+    unsigned head = *E->cq_head;
+    unsigned tail = atomic_load_explicit((atomic_uint *)E->cq_tail,
+                                         memory_order_acquire);
+    int cnt = 0;
+
+    if (min > E->inflight) {
+        min = E->inflight;
+    }
+    if (E->to_submit || tail - head < (unsigned)min) {
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        long rc = syscall(__NR_io_uring_enter, E->ring_fd, E->to_submit,
+                          min, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                          &arg, sizeof(arg));
+        if (rc < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (rc > 0) {
+            E->to_submit -= rc;
+        }
+        tail = atomic_load_explicit((atomic_uint *)E->cq_tail,
+                                    memory_order_acquire);
+    }
+    while (head != tail && cnt < max) {
+        struct io_uring_cqe *cqe =
+            (struct io_uring_cqe *)E->cqes + (head & *E->cq_mask);
+        done[cnt].tag = (void *)(unsigned long)cqe->user_data;
+        done[cnt].res = cqe->res;
+        cnt++;
+        head++;
+    }
+    atomic_store_explicit((atomic_uint *)E->cq_head, head,
+                          memory_order_release);
+    E->inflight -= cnt;
+    return cnt;
+}
+
+#else
+/* without io_uring, there is never an engine */
+IOE *ioe_create (unsigned depth) {
+    return NULL;
+}
+
+void ioe_destroy (IOE *E) {
+}
+
+int ioe_register_buffers (IOE *E, struct iovec *iov, unsigned n) {
+    return -1;
+}
+
+int ioe_recv (IOE *E, int fd, void *buf, size_t len, void *tag) {
+    return -1;
+}
+
+int ioe_send (IOE *E, int fd, const void *buf, size_t len, void *tag) {
+    return -1;
+}
+
+int ioe_wait (IOE *E, IOC *done, int min, int max) {
+    return -1;
+}
+#endif /* IOE_HAVE_URING */
@@ -0,0 +1,54 @@
+/* This header file contains the interfaces to the I/O engine, which
+ * runs socket operations asynchronously on io_uring
+ */
+#ifndef __IOENGINE_H__
+#define __IOENGINE_H__
+
+#include "csapp.h"
+
+#define IOE_MAX_BUFFERS 16      /* registered buffers per engine */
+
+/* the result of an operation: what the system call would have
+ * returned, or -errno
+ */
+typedef struct io_completion {
+    void *tag;
+    int res;
+} IOC;
+
+typedef struct io_engine {
+    int ring_fd;
+    unsigned depth;             /* operations in flight at most */
+    unsigned inflight;
+    unsigned to_submit;         /* queued since the last system call */
+    void *sq_ring;              /* the rings shared with the kernel */
+    void *cq_ring;
+    void *sqes;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    void *cqes;
+    struct iovec buffers[IOE_MAX_BUFFERS];
+    unsigned buffer_cnt;
+} IOE;
+
+IOE *ioe_create (unsigned depth);
+
+void ioe_destroy (IOE *E);
+
+int ioe_register_buffers (IOE *E, struct iovec *iov, unsigned n);
+
+int ioe_recv (IOE *E, int fd, void *buf, size_t len, void *tag);
+
+int ioe_send (IOE *E, int fd, const void *buf, size_t len, void *tag);
+
+int ioe_wait (IOE *E, IOC *done, int min, int max);
+
+#endif /* __IOENGINE_H__ */
@@ -0,0 +1,165 @@
+/* log
+ * leveled logging that keeps stdout off the request path
+ * every thread writes its messages into a ring of its own, with no
+ * lock: the thread is the only producer of its ring and the writer
+ * thread the only consumer, so head and tail are plain atomics
+ * the writer thread drains the rings to stdout in the background
+ *
+ * rings are never freed: when a thread exits its ring is handed to
+ * the next thread that logs, so there are about as many rings as
+ * threads ever ran at the same time
+ * a message that finds its ring full is dropped and counted
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include <stdatomic.h>
+#include <stdarg.h>
+#include "csapp.h"
+#include "log.h"
+
+typedef struct log_ring {
+    struct log_ring *next;      /* every ring ever created */
+    atomic_int in_use;          /* owned by a live thread */
+    atomic_uint head;           /* next slot written by the owner */
+    atomic_uint tail;           /* next slot read by the writer */
+    atomic_uint dropped;        /* messages lost to a full ring */
+    char line[LOG_RING_SIZE][LOG_LINE];
+} LR;
+
+static _Atomic(LR *) log_rings;
+static __thread LR *log_my_ring;
+static pthread_key_t log_key;
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+static sem_t log_mutex;         /* serializes the consumers only */
+
+//=========================================functions
+/* log_release
+ * hands the ring of an exiting thread back to the pool
+ */
+static void log_release (void *ring) {
+    atomic_store_explicit(&((LR *)ring)->in_use, 0, memory_order_release);
+}
+
+static void log_init (void) {
+    pthread_key_create(&log_key, log_release);
+    sem_init(&log_mutex, 0, 1);
+}
+
+/* log_ring
+ * returns the ring of the calling thread, taking a free one from the
+ * pool or creating one on first use
+ */
+static LR *log_ring (void) {
+    LR *ring;
+    if (log_my_ring) {
+        return log_my_ring;
+    }
+    pthread_once(&log_once, log_init);
+    for (ring = atomic_load(&log_rings); ring; ring = ring->next) {
+        int free_ring = 0;
+        if (atomic_compare_exchange_strong(&ring->in_use, &free_ring, 1)) {
+            break;
+        }
+    }
+    if (ring == NULL) {
+        ring = Calloc(1, sizeof(LR));
+        atomic_store(&ring->in_use, 1);
+        ring->next = atomic_load(&log_rings);
+        while (!atomic_compare_exchange_weak(&log_rings, &ring->next, ring)) {
+            ;
+        }
+    }
+    pthread_setspecific(log_key, ring);
+    log_my_ring = ring;
+    return ring;
+}
+
+/* log_write
+ * formats a message into the ring of the calling thread
+ * use the log_debug ... log_error macros, which compile out
+ * the messages below LOG_LEVEL
+ */
+void log_write (int level, const char *fmt, ...) {
+    LR *ring = log_ring();
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    va_list ap;
+
+    if (head - tail == LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    char *line = ring->line[head & (LOG_RING_SIZE - 1)];
+    va_start(ap, fmt);
+    int n = vsnprintf(line, LOG_LINE, fmt, ap);
+    va_end(ap);
+    if (n >= LOG_LINE) {
+        line[LOG_LINE - 2] = '\n';
+    }
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/* log_drain
+ * writes every pending message to stdout
+ * returns the number of messages written
+ */
+static unsigned log_drain (void) {
+    unsigned cnt = 0;
+    LR *ring;
+
+    pthread_once(&log_once, log_init);
+    P(&log_mutex);
+    for (ring = atomic_load(&log_rings); ring; ring = ring->next) {
+        unsigned tail = atomic_load_explicit(&ring->tail,
+                                             memory_order_relaxed);
+        unsigned head = atomic_load_explicit(&ring->head,
+                                             memory_order_acquire);
+        for (; tail != head; tail++, cnt++) {
+            fputs(ring->line[tail & (LOG_RING_SIZE - 1)], stdout);
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        unsigned dropped = atomic_exchange(&ring->dropped, 0);
+        if (dropped) {
+            printf("log: dropped %u messages\n", dropped);
+        }
+    }
+    if (cnt) {
+        fflush(stdout);
+    }
+    V(&log_mutex);
+    return cnt;
+}
+
+/* log_thread
+ * drains the rings, sleeping a little whenever they are all empty
+ */
+static void *log_thread (void *vargp) {
+    struct timespec idle = { 0, LOG_IDLE_NS };
+    Pthread_detach(pthread_self());
+    while (1) {
+        if (log_drain() == 0) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+/* log_start
+ * starts the writer thread; messages logged before are kept
+ * in their rings until then
+ */
+void log_start (void) {
+    pthread_t tid;
+    pthread_once(&log_once, log_init);
+    Pthread_create(&tid, NULL, log_thread, NULL);
+}
+
+/* log_flush
+ * writes the pending messages now, e.g. before exiting
+ */
+void log_flush (void) {
+    log_drain();
+}
@@ -0,0 +1,41 @@
+/* This header file contains the interfaces to the proxy log
+ */
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include "csapp.h"
+
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_ERROR 3
+
+/* messages below LOG_LEVEL are compiled out, e.g. make LOG_LEVEL=0 */
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO
+#endif
+
+#define LOG_RING_SIZE 256       /* messages per thread ring, a power of 2 */
+#define LOG_LINE 256            /* longer messages are truncated */
+#define LOG_IDLE_NS 10000000    /* writer sleep when every ring is empty */
+
+#define log_at(level, ...)                                  \
+    do {                                                    \
+        if ((level) >= LOG_LEVEL) {                         \
+            log_write((level), __VA_ARGS__);                \
+        }                                                   \
+    } while (0)
+
+#define log_debug(...) log_at(LOG_DEBUG, __VA_ARGS__)
+#define log_info(...) log_at(LOG_INFO, __VA_ARGS__)
+#define log_warn(...) log_at(LOG_WARN, __VA_ARGS__)
+#define log_error(...) log_at(LOG_ERROR, __VA_ARGS__)
+
+void log_write (int level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void log_start (void);
+
+void log_flush (void);
+
+#endif /* __LOG_H__ */
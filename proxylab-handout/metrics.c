@@ -0,0 +1,358 @@
+/* metrics
+ * request statistics, exposed in the Prometheus text format
+ * counters are kept in cache-line aligned slots: every thread picks a
+ * slot when it first counts something and updates it with relaxed
+ * atomic adds, so threads almost never touch the same line, and
+ * nothing is locked on the request path
+ * a scrape sums the slots
+ *
+ * every slot also holds an HDR histogram per request phase (see
+ * hist.c); their percentiles are part of the scrape, and are logged
+ * when the proxy gets SIGUSR2
+ *
+ * with -m <port>, a thread answers "GET /metrics" on that port of the
+ * loopback interface
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include <stdatomic.h>
+#include "csapp.h"
+#include "cache.h"
+#include "shm_cache.h"
+#include "metrics.h"
+#include "hist.h"
+#include "log.h"
+
+typedef struct metrics_slot {
+    atomic_ulong counter[M_COUNTERS];
+    atomic_ulong origin_bucket[METRICS_ORIGIN_BUCKETS + 1];
+    HH phase[PH_COUNT];
+} __attribute__((aligned(METRICS_LINE))) MS;
+
+/* upper bounds of the origin latency buckets, in seconds */
+static const double origin_bounds[METRICS_ORIGIN_BUCKETS] = {
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+    0.25, 0.5, 1, 2.5, 5, 10
+};
+
+/* the phase names, and the percentiles reported for them */
+static const char *phase_names[PH_COUNT] = {
+    "parse", "cache", "dns", "connect", "first_byte", "relay", "total"
+};
+static const double phase_quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+#define PHASE_QUANTILES (sizeof(phase_quantiles) / sizeof(double))
+
+static MS metrics_slots[METRICS_SLOTS];
+static atomic_long metrics_gauges[G_GAUGES];
+static atomic_uint metrics_next_slot;
+static __thread MS *metrics_my_slot;
+
+//=========================================functions
+/* metrics_now_ns
+ * returns a monotonic timestamp in nanoseconds
+ */
+unsigned long metrics_now_ns (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* metrics_slot
+ * returns the slot of the calling thread
+ */
+static MS *metrics_slot (void) {
+    if (metrics_my_slot == NULL) {
+        unsigned id = atomic_fetch_add_explicit(&metrics_next_slot, 1,
+                                                memory_order_relaxed);
+        metrics_my_slot = &metrics_slots[id % METRICS_SLOTS];
+    }
+    return metrics_my_slot;
+}
+
+/* metrics_add
+ * adds n to a counter
+ */
+void metrics_add (int counter, unsigned long n) {
+    atomic_fetch_add_explicit(&metrics_slot()->counter[counter], n,
+                              memory_order_relaxed);
+}
+
+/* metrics_gauge
+ * sets a gauge
+ */
+void metrics_gauge (int gauge, long value) {
+    atomic_store_explicit(&metrics_gauges[gauge], value,
+                          memory_order_relaxed);
+}
+
+/* metrics_origin_latency
+ * records how long fetching an object from its server took
+ */
+void metrics_origin_latency (unsigned long ns) {
+    MS *slot = metrics_slot();
+    double seconds = ns / 1e9;
+    int i = 0;
+    while (i < METRICS_ORIGIN_BUCKETS && seconds > origin_bounds[i]) {
+        i++;
+    }
+    atomic_fetch_add_explicit(&slot->origin_bucket[i], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&slot->counter[M_ORIGIN_NS], ns,
+                              memory_order_relaxed);
+}
+
+/* metrics_phase
+ * records how long a request phase took
+ */
+void metrics_phase (int phase, unsigned long ns) {
+    hist_record(&metrics_slot()->phase[phase], ns / 1000);
+}
+
+/* metrics_phase_snapshot
+ * merges the histograms of a phase from all the slots
+ * returns a malloc'ed snapshot
+ */
+static HS *metrics_phase_snapshot (int phase) {
+    HS *snap = Calloc(1, sizeof(HS));
+    int i;
+    for (i = 0; i < METRICS_SLOTS; i++) {
+        hist_add(snap, &metrics_slots[i].phase[phase]);
+    }
+    return snap;
+}
+
+/* metrics_dump_phases
+ * logs the percentiles of every phase, in microseconds
+ */
+void metrics_dump_phases (void) {
+    int phase;
+    log_info("%-10s %10s %8s %8s %8s %8s %8s (us)\n", "phase", "count",
+             "p50", "p90", "p99", "p99.9", "max");
+    for (phase = 0; phase < PH_COUNT; phase++) {
+        HS *snap = metrics_phase_snapshot(phase);
+        log_info("%-10s %10lu %8lu %8lu %8lu %8lu %8lu\n",
+                 phase_names[phase], snap->total,
+                 hist_percentile(snap, 50), hist_percentile(snap, 90),
+                 hist_percentile(snap, 99), hist_percentile(snap, 99.9),
+                 hist_max(snap));
+        Free(snap);
+    }
+}
+
+/* metrics_sum
+ * adds up a counter over all the slots
+ */
+static unsigned long metrics_sum (atomic_ulong *first) {
+    size_t offset = (char *)first - (char *)&metrics_slots[0];
+    unsigned long sum = 0;
+    int i;
+    for (i = 0; i < METRICS_SLOTS; i++) {
+        sum += atomic_load_explicit(
+                (atomic_ulong *)((char *)&metrics_slots[i] + offset),
+                memory_order_relaxed);
+    }
+    return sum;
+}
+
+/* metrics_counter
+ * formats one counter (or gauge) with its help line
+ */
+static size_t metrics_counter (char *buf, size_t max, const char *name,
+                               const char *type, const char *help,
+                               double value) {
+    int n = snprintf(buf, max, "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n",
+                     name, help, name, type, name, value);
+    return (n < 0 || n >= max) ? 0 : n;
+}
+
+/* metrics_format
+ * writes all the statistics into buf in the Prometheus text format
+ * returns the length written
+ */
+size_t metrics_format (CM *Cache, char *buf, size_t max) {
+    static const struct {
+        int id;
+        const char *name;
+        const char *help;
+    } counters[] = {
+        { M_HITS, "proxy_cache_hits_total",
+          "Requests served from the memory cache." },
+        { M_DISK_HITS, "proxy_disk_cache_hits_total",
+          "Requests served from the disk cache." },
+        { M_MISSES, "proxy_cache_misses_total",
+          "Requests fetched from the origin server." },
+        { M_BYTES_SERVED, "proxy_bytes_served_total",
+          "Response bytes written to clients." },
+        { M_EVICTIONS, "proxy_cache_evictions_total",
+          "Blocks evicted from the memory cache." },
+        { M_LOCK_WAITS, "proxy_cache_lock_waits_total",
+          "Cache mutex acquisitions that had to wait." },
+        { M_REJECTED, "proxy_rejected_total",
+          "Connections refused for going over the per-client limits." },
+        { M_SHED, "proxy_shed_total",
+          "Cache misses refused by admission control." },
+        { M_PEER_FETCHES, "proxy_peer_fetches_total",
+          "Cache misses fetched through the peer owning the key." },
+        { M_PREFETCHES, "proxy_prefetches_total",
+          "Objects linked from cached pages and prefetched into the cache." },
+    };
+    size_t n = 0;
+    unsigned i;
+
+    for (i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        n += metrics_counter(buf + n, max - n, counters[i].name, "counter",
+                counters[i].help,
+                metrics_sum(&metrics_slots[0].counter[counters[i].id]));
+    }
+    n += metrics_counter(buf + n, max - n,
+            "proxy_cache_lock_wait_seconds_total", "counter",
+            "Time spent waiting for the cache mutex.",
+            metrics_sum(&metrics_slots[0].counter[M_LOCK_WAIT_NS]) / 1e9);
+
+    size_t cache_size;
+    unsigned block_cnt;
+    if (Cache->shm) {
+        shm_cache_stats(Cache->shm, &cache_size, &block_cnt);
+    }
+    else {
+        P(&Cache->mutex);
+        cache_size = Cache->cache_size;
+        block_cnt = Cache->block_cnt;
+        V(&Cache->mutex);
+    }
+    n += metrics_counter(buf + n, max - n, "proxy_cache_bytes", "gauge",
+            "Bytes held by the memory cache.", cache_size);
+    n += metrics_counter(buf + n, max - n, "proxy_cache_objects", "gauge",
+            "Blocks held by the memory cache.", block_cnt);
+    n += metrics_counter(buf + n, max - n, "proxy_admit_limit", "gauge",
+            "Origin fetches admission control allows at once.",
+            atomic_load(&metrics_gauges[G_ADMIT_LIMIT]));
+    n += metrics_counter(buf + n, max - n, "proxy_admit_inflight", "gauge",
+            "Origin fetches running.",
+            atomic_load(&metrics_gauges[G_ADMIT_INFLIGHT]));
+
+    //the origin latency histogram, with cumulative buckets
+    unsigned long cumulative = 0;
+    n += snprintf(buf + n, max - n,
+            "# HELP proxy_origin_latency_seconds Time to fetch an object "
+            "from its origin server.\n"
+            "# TYPE proxy_origin_latency_seconds histogram\n");
+    for (i = 0; i <= METRICS_ORIGIN_BUCKETS && n < max; i++) {
+        cumulative += metrics_sum(&metrics_slots[0].origin_bucket[i]);
+        if (i < METRICS_ORIGIN_BUCKETS) {
+            n += snprintf(buf + n, max - n,
+                    "proxy_origin_latency_seconds_bucket{le=\"%g\"} %lu\n",
+                    origin_bounds[i], cumulative);
+        }
+        else {
+            n += snprintf(buf + n, max - n,
+                    "proxy_origin_latency_seconds_bucket{le=\"+Inf\"} %lu\n",
+                    cumulative);
+        }
+    }
+    if (n < max) {
+        n += snprintf(buf + n, max - n,
+                "proxy_origin_latency_seconds_sum %.9f\n"
+                "proxy_origin_latency_seconds_count %lu\n",
+                metrics_sum(&metrics_slots[0].counter[M_ORIGIN_NS]) / 1e9,
+                cumulative);
+    }
+
+    //the request phases, as summaries
+    if (n < max) {
+        n += snprintf(buf + n, max - n,
+                "# HELP proxy_phase_seconds Time spent in each request "
+                "phase.\n# TYPE proxy_phase_seconds summary\n");
+    }
+    int phase;
+    for (phase = 0; phase < PH_COUNT && n < max; phase++) {
+        HS *snap = metrics_phase_snapshot(phase);
+        for (i = 0; i < PHASE_QUANTILES && n < max; i++) {
+            n += snprintf(buf + n, max - n,
+                    "proxy_phase_seconds{phase=\"%s\",quantile=\"%g\"} "
+                    "%.6f\n", phase_names[phase], phase_quantiles[i],
+                    hist_percentile(snap, phase_quantiles[i] * 100) / 1e6);
+        }
+        if (n < max) {
+            n += snprintf(buf + n, max - n,
+                    "proxy_phase_seconds_sum{phase=\"%s\"} %.6f\n"
+                    "proxy_phase_seconds_count{phase=\"%s\"} %lu\n",
+                    phase_names[phase], snap->sum / 1e6,
+                    phase_names[phase], snap->total);
+        }
+        Free(snap);
+    }
+    return (n < max) ? n : max;
+}
+
+/* metrics_serve
+ * answers one request on the metrics port
+ */
+static void metrics_serve (int fd, CM *Cache) {
+    char line[MAXLINE], method[MAXLINE], path[MAXLINE], hdr[MAXLINE];
+    char *body;
+    size_t body_len;
+    rio_t rio;
+
+    rio_readinitb(&rio, fd);
+    if (rio_readlineb(&rio, line, MAXLINE) <= 0 ||
+            sscanf(line, "%s %s", method, path) != 2) {
+        return;
+    }
+    while (rio_readlineb(&rio, line, MAXLINE) > 0 && strcmp(line, "\r\n")) {
+        ;
+    }
+    if (strcmp(method, "GET") || strcmp(path, "/metrics")) {
+        sprintf(hdr, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+        rio_writen(fd, hdr, strlen(hdr));
+        return;
+    }
+    body = Malloc(MAXBUF * 4);
+    body_len = metrics_format(Cache, body, MAXBUF * 4);
+    sprintf(hdr, "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %zu\r\n\r\n", body_len);
+    if (rio_writen(fd, hdr, strlen(hdr)) >= 0) {
+        rio_writen(fd, body, body_len);
+    }
+    Free(body);
+}
+
+/* the arguments of metrics_thread */
+typedef struct metrics_args {
+    int listenfd;
+    CM *Cache;
+} metrics_args;
+
+/* metrics_thread
+ * serves scrapes one at a time
+ */
+static void *metrics_thread (void *vargp) {
+    metrics_args *args = (metrics_args *)vargp;
+    Pthread_detach(pthread_self());
+    while (1) {
+        int fd = accept(args->listenfd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        metrics_serve(fd, args->Cache);
+        close(fd);
+    }
+    return NULL;
+}
+
+/* metrics_start
+ * starts serving /metrics on the loopback interface at port
+ */
+void metrics_start (int port, CM *Cache) {
+    pthread_t tid;
+    metrics_args *args = Malloc(sizeof(metrics_args));
+    if ((args->listenfd = open_local_listenfd(port)) < 0) {
+        unix_error("metrics: open_local_listenfd error");
+    }
+    args->Cache = Cache;
+    Pthread_create(&tid, NULL, metrics_thread, args);
+}
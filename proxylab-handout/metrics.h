@@ -0,0 +1,61 @@
+/* This header file contains the interfaces to the proxy statistics
+ */
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include "csapp.h"
+#include "hist.h"
+
+#define METRICS_SLOTS 64            /* threads share slots round-robin */
+#define METRICS_LINE 64             /* cache line size */
+#define METRICS_ORIGIN_BUCKETS 13   /* upper bounds in metrics.c */
+
+/* counters */
+#define M_HITS 0            /* requests served from the memory cache */
+#define M_DISK_HITS 1       /* requests served from the disk cache */
+#define M_MISSES 2          /* requests fetched from the server */
+#define M_BYTES_SERVED 3    /* bytes written to clients */
+#define M_EVICTIONS 4       /* blocks evicted from the memory cache */
+#define M_LOCK_WAITS 5      /* cache mutex acquisitions that blocked */
+#define M_LOCK_WAIT_NS 6    /* time spent blocked on the cache mutex */
+#define M_ORIGIN_NS 7       /* time spent fetching from servers */
+#define M_REJECTED 8        /* connections refused with a 429 */
+#define M_SHED 9            /* misses refused with a 503 */
+#define M_PEER_FETCHES 10   /* misses fetched through the owning peer */
+#define M_PREFETCHES 11     /* objects cached by the prefetcher */
+#define M_COUNTERS 12
+
+/* gauges, set by their owner */
+#define G_ADMIT_LIMIT 0     /* origin fetches allowed at once */
+#define G_ADMIT_INFLIGHT 1  /* origin fetches running */
+#define G_GAUGES 2
+
+/* request phases timed into HDR histograms */
+#define PH_PARSE 0          /* request line read to cache key built */
+#define PH_CACHE 1          /* a hit, served from memory or disk */
+#define PH_DNS 2            /* resolving the server */
+#define PH_CONNECT 3        /* connecting to the server */
+#define PH_FIRST_BYTE 4     /* request sent to first response byte */
+#define PH_RELAY 5          /* first response byte to the end */
+#define PH_TOTAL 6          /* request line read to response sent */
+#define PH_COUNT 7
+
+struct cache_manager;
+
+unsigned long metrics_now_ns (void);
+
+void metrics_add (int counter, unsigned long n);
+
+void metrics_gauge (int gauge, long value);
+
+void metrics_origin_latency (unsigned long ns);
+
+void metrics_phase (int phase, unsigned long ns);
+
+void metrics_dump_phases (void);
+
+size_t metrics_format (struct cache_manager *Cache, char *buf, size_t max);
+
+void metrics_start (int port, struct cache_manager *Cache);
+
+#endif /* __METRICS_H__ */
@@ -0,0 +1,194 @@
+/* peer
+ * cache peering between proxies, such as the proxies of a fleet
+ * every proxy is given the same list of proxies, and places each of them
+ * at PEER_VNODES points of a hash ring; the owner of a key is the proxy
+ * at the first point at or after the hash of the key
+ * a miss for a key owned by another proxy is fetched through the owner,
+ * which caches it, and is not cached by the proxy that asked, so the
+ * fleet holds each object once and caches as much as its proxies
+ * together; adding or removing a proxy only moves the keys of its points
+ *
+ * the request to the owner carries PEER_HDR, and the owner fetches a
+ * miss from the server itself instead of asking a peer again
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include "csapp.h"
+#include "cache.h"
+#include "http.h"
+#include "peer.h"
+#include "log.h"
+
+//=========================================functions
+/* peer_hash
+ * hashes a key or a point onto the ring
+ * FNV-1a barely changes the high bits for the last characters, which
+ * are all that tell the points of a proxy apart, so the hash is mixed
+ * further (the murmur3 finalizer)
+ */
+static unsigned long peer_hash (const char *str) {
+    unsigned long h = cache_hash(str);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53UL;
+    h ^= h >> 33;
+    return h;
+}
+
+static int peer_point_cmp (const void *a, const void *b) {
+    unsigned long ha = ((const PP *)a)->hash, hb = ((const PP *)b)->hash;
+    return (ha > hb) - (ha < hb);
+}
+
+/* peer_ring_create
+ * builds the ring of the proxies in list, host:port pairs separated by
+ * commas, the first of which is this proxy (as the others reach it)
+ * returns NULL if an entry cannot be parsed or resolved
+ */
+PR *peer_ring_create (char *list) {
+    char name[MAXLINE], host[MAXLINE], point[MAXLINE + 16];
+    PR *ring = Calloc(1, sizeof(PR));
+    unsigned i, j;
+    int port;
+
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        if (len == 0 || len >= MAXLINE || ring->node_cnt == PEER_MAX) {
+            goto err;
+        }
+        memcpy(name, list, len);
+        name[len] = '\0';
+        list += len + (list[len] == ',');
+        char *colon = strrchr(name, ':');
+        if (colon == NULL || (port = atoi(colon + 1)) <= 0) {
+            goto err;
+        }
+        memcpy(host, name, colon - name);
+        host[colon - name] = '\0';
+        PN *node = &ring->nodes[ring->node_cnt];
+        strcpy(node->name, name);
+        /* this proxy is never connected to */
+        if (ring->node_cnt > 0 &&
+                resolve_host_r(host, port, &node->addr) < 0) {
+            log_warn("peer: cannot resolve %s\n", name);
+            goto err;
+        }
+        ring->node_cnt++;
+    }
+    if (ring->node_cnt == 0) {
+        goto err;
+    }
+
+    ring->point_cnt = ring->node_cnt * PEER_VNODES;
+    ring->points = Malloc(ring->point_cnt * sizeof(PP));
+    for (i = 0; i < ring->node_cnt; i++) {
+        for (j = 0; j < PEER_VNODES; j++) {
+            PP *p = &ring->points[i * PEER_VNODES + j];
+            snprintf(point, sizeof(point), "%s#%u", ring->nodes[i].name, j);
+            p->hash = peer_hash(point);
+            p->node = &ring->nodes[i];
+        }
+    }
+    qsort(ring->points, ring->point_cnt, sizeof(PP), peer_point_cmp);
+    return ring;
+
+ err:
+    for (i = 1; i < ring->node_cnt; i++) {
+        freeaddrinfo(ring->nodes[i].addr);
+    }
+    Free(ring);
+    return NULL;
+}
+
+/* peer_owner
+ * returns the proxy that owns key, or NULL if it is this proxy
+ */
+PN *peer_owner (PR *ring, const char *key) {
+    unsigned long hash = peer_hash(key);
+    unsigned lo = 0, hi = ring->point_cnt;
+    /* the first point at or after hash, wrapping around */
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (ring->points[mid].hash < hash) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    PN *node = ring->points[lo == ring->point_cnt ? 0 : lo].node;
+    return (node == &ring->nodes[0]) ? NULL : node;
+}
+
+/* peer_connect
+ * connects to a proxy of the ring
+ * returns the connected descriptor, or -1 if the proxy is down
+ */
+int peer_connect (PN *node) {
+    int fd = connect_addrinfo(node->addr);
+    if (fd < 0) {
+        log_warn("peer: cannot connect to %s\n", node->name);
+    }
+    return fd;
+}
+
+/* peer_forwarded
+ * checks if a request was sent by a peer
+ */
+int peer_forwarded (char *client_hdrs) {
+    char value[MAXLINE];
+    return http_header_value(client_hdrs, strlen(client_hdrs), PEER_HDR,
+                             value, MAXLINE);
+}
+
+/* peer_request
+ * builds the request asking the owner for http://host:port/suffix on
+ * behalf of a client; the client's headers are kept, so that the owner
+ * picks the same variant and encoding, but not its range, as the object
+ * is always fetched whole
+ * returns the length of the request, or 0 if it does not fit in max
+ */
+size_t peer_request (PR *ring, char *client_hdrs, char *host, int port,
+                     char *suffix, char *buf, size_t max) {
+    static const char *dropped[] = {
+        "Connection", "Proxy-Connection", "Range", "If-Range", PEER_HDR, NULL
+    };
+    char *line = client_hdrs;
+    size_t n;
+    int i;
+
+    n = snprintf(buf, max, "GET http://%s:%d%s HTTP/1.0\r\n"
+                 "%s: %s\r\nConnection: close\r\n",
+                 host, port, suffix, PEER_HDR, ring->nodes[0].name);
+    if (n >= max) {
+        return 0;
+    }
+    while (*line) {
+        char *eol = strchr(line, '\n');
+        size_t len = eol ? eol + 1 - line : strlen(line);
+        size_t name_len = strcspn(line, ":\n");
+        for (i = 0; dropped[i]; i++) {
+            if (name_len == strlen(dropped[i]) &&
+                    !strncasecmp(line, dropped[i], name_len)) {
+                break;
+            }
+        }
+        if (dropped[i] == NULL) {
+            if (n + len >= max) {
+                return 0;
+            }
+            memcpy(buf + n, line, len);
+            n += len;
+        }
+        line += len;
+    }
+    if (n + 2 >= max) {
+        return 0;
+    }
+    memcpy(buf + n, "\r\n", 3);
+    return n + 2;
+}
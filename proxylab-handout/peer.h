@@ -0,0 +1,41 @@
+/* This header file contains the interfaces to cache peering, which
+ * spreads the objects over several proxies with consistent hashing
+ */
+#ifndef __PEER_H__
+#define __PEER_H__
+
+#include "csapp.h"
+
+#define PEER_MAX 64             /* proxies on the ring */
+#define PEER_VNODES 100         /* points of each proxy on the ring */
+#define PEER_HDR "X-Proxy-Peer" /* marks a request sent by a peer */
+
+typedef struct peer_node {
+    char name[MAXLINE];         /* host:port, as given */
+    struct addrinfo *addr;      /* resolved once, when the ring is made */
+} PN;
+
+typedef struct peer_point {
+    unsigned long hash;
+    PN *node;
+} PP;
+
+typedef struct peer_ring {
+    PN nodes[PEER_MAX];         /* nodes[0] is this proxy */
+    unsigned node_cnt;
+    PP *points;                 /* sorted by hash */
+    unsigned point_cnt;
+} PR;
+
+PR *peer_ring_create (char *list);
+
+PN *peer_owner (PR *ring, const char *key);
+
+int peer_connect (PN *node);
+
+int peer_forwarded (char *client_hdrs);
+
+size_t peer_request (PR *ring, char *client_hdrs, char *host, int port,
+                     char *suffix, char *buf, size_t max);
+
+#endif /* __PEER_H__ */
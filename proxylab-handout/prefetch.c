@@ -0,0 +1,236 @@
+/* prefetch
+ * a browser asks for the images, scripts and style sheets of a page
+ * right after the page itself; when an HTML page is cached, the
+ * resources it links to on the same origin are queued, and fetched into
+ * the cache by a few background threads, so those requests are hits
+ *
+ * at most budget resources are taken from one page, and at most
+ * PREFETCH_QUEUE wait at once; the others are left to the browser
+ * the fetching itself is done by the proxy (prefetch_object in proxy.c),
+ * which skips what is already cached
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#define _GNU_SOURCE
+#include "csapp.h"
+#include "http.h"
+#include "prefetch.h"
+#include "log.h"
+
+//=========================================functions
+/* prefetch_thread
+ * fetches the queued resources, one at a time
+ */
+static void *prefetch_thread (void *vargp) {
+    PF *pf = (PF *)vargp;
+    Pthread_detach(pthread_self());
+    while (1) {
+        P(&pf->items);
+        P(&pf->mutex);
+        PJ *job = pf->head;
+        pf->head = job->next;
+        if (pf->head == NULL) {
+            pf->tail = NULL;
+        }
+        pf->cnt--;
+        V(&pf->mutex);
+        pf->fetch(job->uri, job->client_hdrs);
+        Free(job->uri);
+        Free(job->client_hdrs);
+        Free(job);
+    }
+    return NULL;
+}
+
+/* prefetch_create
+ * starts a prefetcher taking up to budget resources from a page,
+ * which fetch(uri, client_hdrs) fetches into the cache
+ */
+PF *prefetch_create (unsigned budget,
+                     void (*fetch)(char *uri, char *client_hdrs)) {
+    PF *pf = Calloc(1, sizeof(PF));
+    pthread_t tid;
+    int i;
+    pf->budget = budget;
+    pf->fetch = fetch;
+    Sem_init(&pf->mutex, 0, 1);
+    Sem_init(&pf->items, 0, 0);
+    for (i = 0; i < PREFETCH_THREADS; i++) {
+        Pthread_create(&tid, NULL, prefetch_thread, pf);
+    }
+    return pf;
+}
+
+/* prefetch_push
+ * queues a resource
+ * returns 0, or -1 if the queue is full
+ */
+static int prefetch_push (PF *pf, char *uri, char *client_hdrs) {
+    P(&pf->mutex);
+    if (pf->cnt == PREFETCH_QUEUE) {
+        V(&pf->mutex);
+        return -1;
+    }
+    PJ *job = Malloc(sizeof(PJ));
+    job->uri = Malloc(strlen(uri) + 1);
+    strcpy(job->uri, uri);
+    job->client_hdrs = Malloc(strlen(client_hdrs) + 1);
+    strcpy(job->client_hdrs, client_hdrs);
+    job->next = NULL;
+    if (pf->tail) {
+        pf->tail->next = job;
+    }
+    else {
+        pf->head = job;
+    }
+    pf->tail = job;
+    pf->cnt++;
+    V(&pf->mutex);
+    V(&pf->items);
+    return 0;
+}
+
+/* prefetch_tag
+ * checks if the tag starting at tag (after its '<') is called name
+ */
+static int prefetch_tag (const char *tag, const char *end, const char *name) {
+    size_t len = strlen(name);
+    return end - tag > len && !strncasecmp(tag, name, len) &&
+           (isspace((unsigned char)tag[len]) || tag[len] == '/');
+}
+
+/* prefetch_attr
+ * copies the value of the attribute name of the tag [tag, end) to value
+ * returns 1 if the tag has the attribute, 0 otherwise
+ */
+static int prefetch_attr (const char *tag, const char *end,
+                          const char *name, char *value, size_t max) {
+    size_t len = strlen(name), n = 0;
+    const char *p;
+    for (p = tag + 1; p + len < end; p++) {
+        if (!isspace((unsigned char)p[-1]) || strncasecmp(p, name, len)) {
+            continue;
+        }
+        const char *v = p + len;
+        while (v < end && isspace((unsigned char)*v)) {
+            v++;
+        }
+        if (v == end || *v != '=') {
+            continue;
+        }
+        v++;
+        while (v < end && isspace((unsigned char)*v)) {
+            v++;
+        }
+        char quote = (v < end && (*v == '"' || *v == '\'')) ? *v++ : '\0';
+        while (v < end && n + 1 < max &&
+               (quote ? *v != quote : !isspace((unsigned char)*v))) {
+            value[n++] = *v++;
+        }
+        value[n] = '\0';
+        return 1;
+    }
+    return 0;
+}
+
+/* prefetch_resolve
+ * turns a link found in the page at uri into an absolute uri in out
+ * returns 0, or -1 if the link is on another origin or not plain http
+ */
+static int prefetch_resolve (char *uri, char *link, char *out, size_t max) {
+    size_t origin_len, dir_len, n;
+    char *path;
+
+    if (strncasecmp(uri, "http://", 7)) {
+        return -1;
+    }
+    path = strchr(uri + 7, '/');
+    origin_len = path ? path - uri : strlen(uri);
+    link[strcspn(link, "#")] = '\0';
+    if (link[0] == '\0' || strstr(link, "..")) {
+        return -1;
+    }
+    if (!strncmp(link, "//", 2)) {
+        n = snprintf(out, max, "http:%s", link);
+    }
+    else if (strcspn(link, ":") < strcspn(link, "/?")) {
+        /* a scheme: http on the same origin, or nothing */
+        n = snprintf(out, max, "%s", link);
+        if (strncasecmp(link, "http://", 7)) {
+            return -1;
+        }
+    }
+    else if (link[0] == '/') {
+        n = snprintf(out, max, "%.*s%s", (int)origin_len, uri, link);
+    }
+    else {
+        /* relative to the directory of the page */
+        dir_len = path ? strcspn(path, "?") : 0;
+        while (dir_len > 0 && path[dir_len - 1] != '/') {
+            dir_len--;
+        }
+        n = snprintf(out, max, "%.*s%.*s%s%s", (int)origin_len, uri,
+                     (int)dir_len, path ? path : "", dir_len ? "" : "/", link);
+    }
+    if (n >= max || strncasecmp(out, uri, origin_len) ||
+            (out[origin_len] != '/' && out[origin_len] != '\0')) {
+        return -1;
+    }
+    return 0;
+}
+
+/* prefetch_page
+ * queues the images, scripts, style sheets and icons linked from a
+ * response to uri, if it is an HTML page, for the client with headers
+ * client_hdrs; compressed pages are not looked into
+ * returns the number of resources queued
+ */
+unsigned prefetch_page (PF *pf, char *uri, char *client_hdrs,
+                        char *data, size_t size) {
+    char value[MAXLINE], link[MAXLINE];
+    size_t hdr_size = size ? http_header_end(data, size) : 0;
+    unsigned queued = 0;
+    char *p, *end = data + size;
+
+    if (hdr_size == 0 || http_status(data, hdr_size) != 200 ||
+            http_header_value(data, hdr_size, "Content-Encoding",
+                              value, MAXLINE) ||
+            !http_header_value(data, hdr_size, "Content-Type",
+                               value, MAXLINE) ||
+            strncasecmp(value, "text/html", 9)) {
+        return 0;
+    }
+    for (p = data + hdr_size; queued < pf->budget &&
+             (p = memchr(p, '<', end - p)) != NULL; ) {
+        char *close = memchr(p, '>', end - p);
+        const char *attr = NULL;
+        if (close == NULL) {
+            break;
+        }
+        if (prefetch_tag(p + 1, close, "img") ||
+                prefetch_tag(p + 1, close, "script")) {
+            attr = "src";
+        }
+        else if (prefetch_tag(p + 1, close, "link") &&
+                 prefetch_attr(p, close, "rel", value, MAXLINE) &&
+                 (strcasestr(value, "stylesheet") ||
+                  strcasestr(value, "icon"))) {
+            attr = "href";
+        }
+        if (attr && prefetch_attr(p, close, attr, value, MAXLINE) &&
+                prefetch_resolve(uri, value, link, MAXLINE) == 0) {
+            if (prefetch_push(pf, link, client_hdrs) < 0) {
+                break;
+            }
+            queued++;
+        }
+        p = close + 1;
+    }
+    if (queued) {
+        log_debug("prefetch: %u resources of %s\n", queued, uri);
+    }
+    return queued;
+}
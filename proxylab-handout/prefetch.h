@@ -0,0 +1,34 @@
+/* This header file contains the interfaces to the prefetcher, which
+ * warms the cache with the resources linked from cached HTML pages
+ */
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+#include "csapp.h"
+
+#define PREFETCH_THREADS 4      /* fetching at the same time */
+#define PREFETCH_QUEUE 256      /* resources waiting at most */
+
+typedef struct prefetch_job {
+    struct prefetch_job *next;
+    char *uri;                  /* absolute, on the origin of the page */
+    char *client_hdrs;          /* of the request for the page */
+} PJ;
+
+typedef struct prefetcher {
+    PJ *head;
+    PJ *tail;
+    unsigned cnt;
+    unsigned budget;            /* resources taken from one page */
+    void (*fetch)(char *uri, char *client_hdrs);
+    sem_t mutex;                /* protects the queue */
+    sem_t items;                /* counts waiting jobs */
+} PF;
+
+PF *prefetch_create (unsigned budget,
+                     void (*fetch)(char *uri, char *client_hdrs));
+
+unsigned prefetch_page (PF *pf, char *uri, char *client_hdrs,
+                        char *data, size_t size);
+
+#endif /* __PREFETCH_H__ */
@@ -20,12 +20,145 @@
  * Used a linked stack to implement a LRU cache
  * if an node is inserted, place it after the additional header
  * it an node is visited, move it after the additional header
- * if the cache is bigger than MAX_CACHE_SIZE, simple evict nodes at the end
+ * if the cache is bigger than its capacity, simple evict nodes at the end
+ * the capacity and the largest cacheable object default to MAX_CACHE_SIZE
+ * and MAX_OBJECT_SIZE, and can be set with -c and -o (e.g. -c 4G -o 16M);
+ * objects are limited to CACHE_OBJECT_LIMIT (just under 4G), as sizes are unsigned
+ * with -e fifo, hits do not move nodes, and nodes are evicted in the
+ * order they were inserted; proxy-sim (sim.c) compares the policies
+ *
+ * Shared cache
+ * with -S <name>, the memory cache lives in the POSIX shared memory
+ * region name (see shm_cache.c), created with the -c size by the first
+ * proxy; every proxy started with the same name uses the same cache, so
+ * an object fetched by one is a hit for all; the region is used in FIFO
+ * order, and cannot be combined with -d or -s
+ *
+ * Disk cache
+ * with -d <file>, nodes evicted from the memory cache are appended to a
+ * log file on disk (see disk_cache.c); a memory miss looks there before
+ * going to the server, and disk hits are sent with sendfile
+ *
+ * Cache keys
+ * objects are cached under the normalized uri (lowercased host, no
+ * default port, and with -q sorted query parameters), and responses
+ * with a Vary header are cached per variant
+ *
+ * Compression
+ * with -z, text responses are stored gzipped (see compress.c); clients
+ * sending "Accept-Encoding: gzip" get the stored form, the others get
+ * the body inflated on the fly
+ *
+ * Ranges
+ * a "Range: bytes=..." request is answered with a 206 cut out of the
+ * cached object; on a miss the whole object is fetched and cached first
+ *
+ * HEAD and conditional requests
+ * a HEAD request is answered with the headers of the cached object, or
+ * else of a cached HEAD response; a HEAD that misses is sent to the
+ * server (not through peers), and its response cached without a body
+ * a GET whose If-None-Match or If-Modified-Since matches the cached
+ * object gets a 304 (see head.c); a 404 is cached for
+ * CACHE_NEGATIVE_TTL seconds only
+ *
+ * Snapshot
+ * with -s <file>, the memory cache is written to a snapshot file on
+ * SIGUSR1 and on SIGINT/SIGTERM (before exiting), and mapped back when
+ * the proxy starts, so a restarted proxy begins with a warm cache
+ *
+ * Metrics
+ * with -m <port>, counters (hits, misses, bytes served, evictions, cache
+ * lock waits) and an origin latency histogram are served in the
+ * Prometheus text format at http://127.0.0.1:<port>/metrics, along with
+ * the percentiles of each request phase (parse, cache hit, dns, connect,
+ * first byte, relay, total); SIGUSR2 logs those percentiles
+ *
+ * Workers and rate limiting
+ * connections are served by a pool of -w worker threads (default
+ * PROXY_WORKERS); while they are all busy, connections wait in a fair
+ * queue that serves the waiting clients in turn (see fqueue.c)
+ * with -r rate[:burst], each client address may open rate connections
+ * per second, in bursts of burst (default 2 * rate); connections over
+ * the limit, or over FQ_CLIENT_MAX waiting, get a 429 (see ratelimit.c)
+ *
+ * Listeners
+ * by default one thread accepts every connection and hands it to the
+ * fair queue; with -R, every worker opens its own SO_REUSEPORT listener
+ * on the port, is pinned to one of the cores the proxy may run on, and
+ * serves the connections it accepts itself, so the kernel spreads the
+ * accepts and a connection stays on one core from accept to close
+ * the rate limit still applies, but there is no fair queue: a connection
+ * waits in the backlog of the listener it was hashed to
+ *
+ * Coroutines
+ * with -C conns, each worker thread (by default one per core) runs a
+ * coroutine scheduler (see coro.c) with up to conns requests in flight;
+ * every request runs doit in a coroutine of its own, on non-blocking
+ * sockets, and waits for them in epoll instead of blocking the thread
+ * the threads share the listener, or with -R have one each; DNS lookups
+ * still block the thread, so origins are best given by address
+ *
+ * Admission control
+ * misses may only keep so many origin fetches going at once; the limit
+ * (at most -a, by default 3/4 of the workers, 0 disables it) adapts to
+ * the origin's latency, and misses over it get a 503 (see admit.c), so
+ * that a slow origin cannot tie up the workers that serve cache hits;
+ * a fetch holds its slot until the object is read, and an origin that
+ * sends nothing for FIRST_BYTE_TIMEOUT_MS gets the client a 504
+ *
+ * Peering
+ * with -P self,peer,..., where every entry is a host:port and the first
+ * one is this proxy, each key is owned by one of the proxies, chosen by
+ * consistent hashing (see peer.c); a miss for a key owned by another
+ * proxy is fetched through that proxy, which caches it, and is not
+ * cached here; if the owner is down, the server is asked directly
+ *
+ * Prefetching
+ * with -p budget, when an HTML page is cached, up to budget of the
+ * images, scripts and style sheets it links to on the same server are
+ * fetched into the cache in the background (see prefetch.c), for the
+ * browser that will ask for them next; misses the admission control
+ * would shed are not prefetched
+ *
+ * Chunked responses
+ * a response the server sends with "Transfer-Encoding: chunked" is
+ * relayed with its body decoded and ended by the close of the connection
+ * (see chunked.c), and cached with a Content-Length
+ *
+ * Relay
+ * a miss is relayed to the client in chunks; with io_uring, sending a
+ * chunk to the client and receiving the next one from the server are
+ * submitted together (see relay.c and ioengine.c); -E rio relays with
+ * blocking reads and writes, as does a kernel without io_uring
+ *
+ * Logging
+ * messages go through log.c, which buffers them per thread and writes
+ * them from a background thread; debug messages are compiled out unless
+ * the proxy is built with make LOG_LEVEL=0
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <sched.h>
 #include "csapp.h"
 #include "cache.h"
+#include "disk_cache.h"
+#include "shm_cache.h"
+#include "compress.h"
+#include "http.h"
+#include "range.h"
+#include "metrics.h"
+#include "log.h"
+#include "ratelimit.h"
+#include "fqueue.h"
+#include "admit.h"
+#include "relay.h"
+#include "coro.h"
+#include "peer.h"
+#include "prefetch.h"
+#include "chunked.h"
+#include "arena.h"
+#include "head.h"
 
 /* You won't lose style points for including these long lines in your code */
 static const char *user_agent_hdr = "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 Firefox/10.0.3\r\n";
@@ -35,20 +168,59 @@ static const char *host_hdr = "Host: %s\r\n";
 static const char *connection_hdr = "Connection: close\r\n";
 static const char *proxy_connection_hdr = "Proxy-Connection: close\r\n";
 
+/* initial size of the per-request object buffer */
+#define OBJECT_BUF_INIT 16384
+/* initial size of the buffer the request is read into, see riob_init */
+#define CLIENT_BUF_INIT 2048
+/* default number of worker threads */
+#define PROXY_WORKERS 64
+/* an origin fetch that sends nothing for this long has failed */
+#define FIRST_BYTE_TIMEOUT_MS 10000
+
+/* LA stands for listener arguments, passed to each listener_thread
+ * and coroutine_thread
+ */
+typedef struct listener_args {
+    int listenfd;               /* with -R, this worker's own socket */
+    int cpu;                    /* the core it is pinned to, or -1 */
+    RL *limiter;                /* shared by all listeners, or NULL */
+    unsigned max_conns;         /* with -C, requests in flight at most */
+} LA;
+
 //========================function declarations
 void get_key_from_client_header(char *header_client, char *key);
 int parse_uri(char *uri, char *host, char *suffix);
-void config_header_server (rio_t *client_riop, char *header_buf,
-                           char *host, char *suffix);
+int read_client_headers(riob_t *client_riop, char *hdrs, size_t max);
+int config_header_server (char *client_hdrs, char *header_buf, size_t max,
+                          char *method, char *host, char *suffix);
 void clienterror(int fd, char *cause, char *errnum, char *smsg, char *lmsg);
-void *doit_thread(void *vargp);
+void *worker_thread(void *vargp);
+void *listener_thread(void *vargp);
+void *coroutine_thread(void *vargp);
+int accept_client(int listenfd, RL *limiter, unsigned *addr);
+void reject_client(int connfd);
 void doit(int connfd_client);
-void serve_cached (CM *mycache, char *uri, int connfd_client);
+void serve_request(int connfd_client, riob_t *rio_client, AR *arena);
+int serve_cached (CM *mycache, char *key, char *header_server,
+                  char *client_hdrs, BR *range, int head, int connfd_client);
+void prefetch_object(char *uri, char *client_hdrs);
+void *signal_thread(void *vargp);
+void usage(char *prog);
 //========================functions and variables
 /* CM stands for cache manager
  * which is an additional data structure for managing the cache
  */
 CM *mycache;
+/* whether query parameters are sorted in cache keys */
+int sort_query = 0;
+/* where the cache snapshot is saved and loaded, NULL if disabled */
+char *snapshot_path = NULL;
+/* admission control of cache misses, NULL if disabled */
+AC *admission = NULL;
+/* the proxies sharing the cache with this one, NULL if disabled */
+PR *peers = NULL;
+/* fetches the resources of cached pages, NULL if disabled */
+PF *prefetcher = NULL;
 /* get_key_from_client_header
  * parses client's header, and get the key
  */
@@ -68,249 +240,1047 @@ void get_key_from_client_header(char *header_from_client, char *key) {
 /* parse_uri: parses the uri, stores the host part and suffix part in strings
  * and returns the port number
  * If the port number is not specified, then simply return default port(80)
+ * returns -1 if the uri has no host
  */
 int parse_uri(char *uri, char *host, char *suffix) {
     char uribuf[MAXLINE];
     strcpy(uribuf, uri);
     char *uribuf_ptr = uribuf;
-
-    char port_buf[MAXLINE];
-    char *port_start;
+    char *host_start = host;
     int port;
 
-    if (!strncmp(uribuf, "http://", 7)) {
+    if (!strncasecmp(uribuf, "http://", 7)) {
         uribuf_ptr += 7;
     }
     //get hostname
-    while (*uribuf_ptr != ':' && *uribuf_ptr != '/') {
+    while (*uribuf_ptr != ':' && *uribuf_ptr != '/' && *uribuf_ptr != '\0') {
         *host++ = *uribuf_ptr++;
     }
     *host = '\0';
-    if (*uribuf_ptr == '/') {
-        while (*uribuf_ptr != '\0') {
-            *suffix++ = *uribuf_ptr++;
-        }
-        port = 80;
+    if (host == host_start) {
+        return -1;
     }
+    port = 80;
     //there is port number
-    else {
-        uribuf_ptr++;
-        port_start = uribuf_ptr;/*remember the start of port section*/
-        while (*uribuf_ptr != '/') {
-            uribuf_ptr++;
+    if (*uribuf_ptr == ':') {
+        char *port_end;
+        port = strtol(uribuf_ptr + 1, &port_end, 10);
+        if (port_end == uribuf_ptr + 1 ||
+                (*port_end != '/' && *port_end != '\0')) {
+            return -1;
         }
-        *uribuf_ptr = '\0';/*make strcpy happy*/
-        strcpy(port_buf, port_start);/*get the port string*/
-        *uribuf_ptr = '/';/*restore uribuf_ptr*/
-        port = atoi(port_buf);/*convert to integer*/
-        strcpy(suffix, uribuf_ptr);
+        uribuf_ptr = port_end;
     }
+    strcpy(suffix, (*uribuf_ptr == '/') ? uribuf_ptr : "/");
     return port;
 }
+/* read_client_headers: reads the client's request headers
+ * up to the blank line and keeps them in hdrs
+ * the lines are found with memchr in the reader's buffer (riob_peek),
+ * and only the ones kept are copied; headers that do not fit in max
+ * bytes are dropped, and so are lines longer than RIOB_MAXSIZE
+ * returns 0 on success, -1 if reading from the client failed
+ */
+int read_client_headers(riob_t *client_riop, char *hdrs, size_t max) {
+    size_t len = 0, cnt, n;
+    char *data, *eol;
+    int skip = 0;               /* in the rest of a line that is dropped */
+
+    hdrs[0] = '\0';
+    while ((data = riob_peek(client_riop, &cnt)) != NULL && cnt > 0) {
+        if ((eol = memchr(data, '\n', cnt)) == NULL) {
+            //a partial line: read the rest of it into the buffer
+            ssize_t nread = skip ? 0 : riob_fill(client_riop);
+            if (nread > 0) {
+                continue;
+            }
+            if (nread < 0 && errno != ENOBUFS) {
+                return -1;
+            }
+            if (nread == 0 && !skip) {
+                return 0;       /* the client closed within a line */
+            }
+            skip = 1;
+            riob_consume(client_riop, cnt);
+            continue;
+        }
+        n = eol + 1 - data;
+        if (!skip && (n == 1 || (n == 2 && data[0] == '\r'))) {
+            riob_consume(client_riop, n);
+            return 0;
+        }
+        if (!skip && len + n < max) {
+            memcpy(hdrs + len, data, n);
+            len += n;
+            hdrs[len] = '\0';
+        }
+        skip = 0;
+        riob_consume(client_riop, n);
+    }
+    return (data == NULL) ? -1 : 0;
+}
+/* header_append
+ * copies len bytes of src to ptr, if they fit before end with room
+ * for the final blank line and the null
+ * returns the end of the copy, or NULL if it does not fit
+ */
+static char *header_append(char *ptr, char *end, const char *src,
+                           size_t len) {
+    if (ptr == NULL || len + 3 > (size_t)(end - ptr)) {
+        return NULL;
+    }
+    memcpy(ptr, src, len);
+    return ptr + len;
+}
 /* config_header_server: configures the header to server
  * extract information from client's header
  * and configure a new header, which is forwarded to server
+ * ranges are never forwarded: whole objects are fetched and cached,
+ * and ranges are served from them
+ * method is GET, or HEAD for a HEAD that missed
+ * returns 0, or -1 if the header does not fit in max bytes
  */
-void config_header_server (rio_t *client_riop, char *header_buf,
-                           char *host, char *suffix) {
-    char client_request_buf[MAXLINE];
-    char host_buf[MAXLINE];
-    char other_buf[MAXLINE];
-    char key[MAXLINE];
+int config_header_server (char *client_hdrs, char *header_buf, size_t max,
+                          char *method, char *host, char *suffix) {
+    /* the client's headers the proxy replaces with its own */
+    static const char *replaced[] = {
+        "Host", "User-Agent", "Accept", "Accept-Encoding", "Connection",
+        "Proxy-Connection", "Range", "If-Range", PEER_HDR, NULL
+    };
+    char *ptr = header_buf, *end = header_buf + max, *line;
+    char host_line[MAXLINE];
+    size_t len, name_len;
+    int i, have_host = 0;
 
-    Rio_readlineb(client_riop, client_request_buf, MAXLINE);
-    while (strcmp(client_request_buf, "\r\n")) {
-        sprintf(host_buf, host_hdr, host);
-        get_key_from_client_header(client_request_buf, key);
-        if (!strcmp(key, "Host")) {
-            memset(host_buf, 0, strlen(host_buf));
-            strcpy(host_buf, client_request_buf);
-        }
-        else if (strcmp(key, "User-Agent") &&
-                 strcmp(key, "Accept") &&
-                 strcmp(key, "Accept-Encoding") &&
-                 strcmp(key, "Connection") &&
-                 strcmp(key, "Proxy-Connection")) {
-            strcpy(other_buf, client_request_buf);
-        }
-        //read the next line
-        if (Rio_readlineb(client_riop, client_request_buf, MAXLINE) < 0) {
+    //every line is bounded by max, so a request line and client_hdrs
+    //near their own limits fail the request instead of overflowing
+    ptr = header_append(ptr, end, method, strlen(method));
+    ptr = header_append(ptr, end, " ", 1);
+    ptr = header_append(ptr, end, suffix, strlen(suffix));
+    ptr = header_append(ptr, end, " HTTP/1.0\r\n", 11);
+    for (line = client_hdrs; *line; line += len) {
+        len = strcspn(line, "\n") + (line[strcspn(line, "\n")] == '\n');
+        if (strcspn(line, ":\n") == 4 && !strncasecmp(line, "Host", 4)) {
+            ptr = header_append(ptr, end, line, len);
+            have_host = 1;
             break;
         }
     }
-    char header_buf_temp[MAXLINE];
-    sprintf(header_buf_temp, "GET %s HTTP/1.0\r\n", suffix);
-    strcat(header_buf, header_buf_temp);
-    strcat(header_buf, host_buf);
-    strcat(header_buf, user_agent_hdr);
-    strcat(header_buf, accept_hdr);
-    strcat(header_buf, accept_encoding_hdr);
-    strcat(header_buf, connection_hdr);
-    strcat(header_buf, proxy_connection_hdr);
-    strcat(header_buf, "\r\n");
-    strcat(header_buf, other_buf);
+    if (!have_host) {
+        len = snprintf(host_line, MAXLINE, host_hdr, host);
+        ptr = (len < MAXLINE) ? header_append(ptr, end, host_line, len) : NULL;
+    }
+    ptr = header_append(ptr, end, user_agent_hdr, strlen(user_agent_hdr));
+    ptr = header_append(ptr, end, accept_hdr, strlen(accept_hdr));
+    ptr = header_append(ptr, end, accept_encoding_hdr,
+                        strlen(accept_encoding_hdr));
+    ptr = header_append(ptr, end, connection_hdr, strlen(connection_hdr));
+    ptr = header_append(ptr, end, proxy_connection_hdr,
+                        strlen(proxy_connection_hdr));
+    for (line = client_hdrs; *line; line += len) {
+        len = strcspn(line, "\n") + (line[strcspn(line, "\n")] == '\n');
+        name_len = strcspn(line, ":\n");
+        for (i = 0; replaced[i]; i++) {
+            if (name_len == strlen(replaced[i]) &&
+                    !strncasecmp(line, replaced[i], name_len)) {
+                break;
+            }
+        }
+        if (replaced[i] == NULL) {
+            ptr = header_append(ptr, end, line, len);
+        }
+    }
+    if (ptr == NULL) {
+        return -1;
+    }
+    //header_append left room for these
+    strcpy(ptr, "\r\n");
 
-    return;
+    return 0;
 }
 /* clienterror
  * configures error messages
  * I copied this function from CSAPP.
+ * a client that went away is not an error: the response is dropped
  */
 void clienterror(int fd, char *cause, char *errnum, char *smsg, char *lmsg) {
     char buf[MAXLINE], body[MAXBUF];
+    struct iovec iov[2];
     /* Build the HTTP response body */
-    sprintf(body, "<html><title>Proxy Error</title>");
-    sprintf(body, "%s<body bgcolor=""ffffff"">\r\n", body);
-    sprintf(body, "%s%s: %s\r\n", body, errnum, smsg);
-    sprintf(body, "%s<p>%s: %s\r\n", body, lmsg, cause);
-    sprintf(body, "%s<hr><em>The Tiny Web server</em>\r\n", body);
+    iov[1].iov_base = body;
+    iov[1].iov_len = snprintf(body, MAXBUF,
+                              "<html><title>Proxy Error</title>"
+                              "<body bgcolor=""ffffff"">\r\n"
+                              "%s: %s\r\n"
+                              "<p>%s: %.512s\r\n"
+                              "<hr><em>The Tiny Web server</em>\r\n",
+                              errnum, smsg, lmsg, cause);
 
-    /* Print the HTTP response */
-    sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, smsg);
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-type: text/html\r\n");
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-length: %d\r\n\r\n", (int)strlen(body));
-    Rio_writen(fd, buf, strlen(buf));
-    Rio_writen(fd, body, strlen(body));
+    /* Print the HTTP response, headers and body in one writev */
+    iov[0].iov_base = buf;
+    iov[0].iov_len = snprintf(buf, sizeof(buf), "HTTP/1.0 %s %s\r\n"
+                              "Content-type: text/html\r\n"
+                              "Content-length: %d\r\n\r\n",
+                              errnum, smsg, (int)iov[1].iov_len);
+    if (rio_writevn(fd, iov, 2) < 0) {
+        log_debug("Client left before the %s error was sent\n", errnum);
+    }
+}
+/* worker_thread
+ * serves the connections handed out by the fair queue
+ * featuring figure 12.28, CSAPP 2e
+ */
+void *worker_thread(void *vargp) {
+    FQ *queue = (FQ *)vargp;
+    Pthread_detach(pthread_self());
+    while (1) {
+        int connfd_client = fq_remove(queue);
+        doit(connfd_client);
+        close(connfd_client);
+    }
+    return NULL;
 }
-/* doit_thread
- * basically a wrapper for doit
+/* pin_to_cpu
+ * keeps the calling thread on one core, if cpu is not -1
  */
-void *doit_thread(void *vargp) {
-    int connfd_client = *((int *)vargp);
+static void pin_to_cpu(int cpu) {
+    cpu_set_t cpus;
+    int rc;
+    if (cpu < 0) {
+        return;
+    }
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if ((rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))) {
+        log_warn("cannot pin thread to cpu %d: %s\n", cpu, strerror(rc));
+    }
+}
+/* listener_thread
+ * with -R, pins itself to a core, then accepts connections on its own
+ * listener and serves them, without going through the fair queue
+ */
+void *listener_thread(void *vargp) {
+    LA *args = (LA *)vargp;
+    unsigned addr;
+    int connfd_client;
     Pthread_detach(pthread_self());
-    Free(vargp);
+    pin_to_cpu(args->cpu);
+    while (1) {
+        connfd_client = accept_client(args->listenfd, args->limiter, &addr);
+        if (connfd_client < 0) {
+            continue;
+        }
+        doit(connfd_client);
+        close(connfd_client);
+    }
+    return NULL;
+}
+/* client_coroutine
+ * serves one connection, in a coroutine of its own
+ */
+static void client_coroutine(void *vargp) {
+    int connfd_client = (int)(long)vargp;
     doit(connfd_client);
-    Close(connfd_client);
+    close(connfd_client);
+}
+/* acceptor_coroutine
+ * accepts connections and starts a coroutine for each, keeping
+ * at most max_conns of them in flight
+ */
+static void acceptor_coroutine(void *vargp) {
+    LA *args = (LA *)vargp;
+    SCH *sched = co_scheduler();
+    unsigned addr;
+    int connfd_client;
+    while (1) {
+        /* the acceptor is one of the live coroutines */
+        while (sched->live > args->max_conns) {
+            co_wait_exit();
+        }
+        connfd_client = accept_client(args->listenfd, args->limiter, &addr);
+        if (connfd_client < 0) {
+            continue;
+        }
+        co_spawn(sched, client_coroutine, (void *)(long)connfd_client);
+    }
+}
+/* coroutine_thread
+ * with -C, runs the requests of this thread as coroutines
+ */
+void *coroutine_thread(void *vargp) {
+    LA *args = (LA *)vargp;
+    SCH *sched = co_scheduler_create();
+    Pthread_detach(pthread_self());
+    pin_to_cpu(args->cpu);
+    co_spawn(sched, acceptor_coroutine, args);
+    co_run(sched);
     return NULL;
 }
+/* accept_client
+ * accepts a connection on listenfd and sets addr to the client address
+ * in a coroutine, the listener and the connection are non-blocking
+ * returns the connected descriptor, or -1 on an error or if the client
+ * is over the rate limit, in which case it already got a 429
+ */
+int accept_client(int listenfd, RL *limiter, unsigned *addr) {
+    struct sockaddr_in clientaddr;
+    socklen_t clientlen = sizeof(clientaddr);
+    int connfd, flags = rio_has_wait_hook() ? SOCK_NONBLOCK : 0;
+    while ((connfd = accept4(listenfd, (SA *) &clientaddr, &clientlen,
+                             flags)) < 0) {
+        if (errno == EAGAIN && rio_wait_fd(listenfd, POLLIN) == 0) {
+            continue;
+        }
+        log_warn("accept error: %s\n", strerror(errno));
+        return -1;
+    }
+    *addr = ntohl(clientaddr.sin_addr.s_addr);
+    if (limiter && !rl_allow(limiter, *addr)) {
+        reject_client(connfd);
+        return -1;
+    }
+    return connfd;
+}
+/* reject_client
+ * answers a connection that is not served with a 429, and closes it
+ */
+void reject_client(int connfd) {
+    metrics_add(M_REJECTED, 1);
+    clienterror(connfd, "", "429", "Too Many Requests",
+                "Too many requests from your address");
+    close(connfd);
+}
 /* serve_cached: send the content of a cached object back to client
- * Works when the requested object is in the cache
+ * looks in the memory cache first, then in the disk cache
+ * key is the normalized uri, header_server the request headers as they
+ * would be sent to the server, which select the variant of the object
+ * compressed objects are sent as stored if the client accepts gzip
+ * if range is not NULL, only the requested bytes are sent, and with
+ * head only the headers; a request the cached object satisfies the
+ * validators of gets a 304
+ * returns 1 if the object was cached, 0 otherwise
  */
-void serve_cached (CM *mycache, char *uri, int connfd_client) {
-    printf("Cache hit\n");
-    CB *cached_obj =cache_get(mycache, uri);
+int serve_cached (CM *mycache, char *key, char *header_server,
+                  char *client_hdrs, BR *range, int head, int connfd_client) {
+    CB *cached_obj = cache_get(mycache, key, header_server);
+    if (cached_obj == NULL) {
+        if (mycache->disk && (head ?
+                disk_cache_serve_head(mycache->disk, key, connfd_client) :
+                disk_cache_serve(mycache->disk, key, connfd_client, range))) {
+            return 1;
+        }
+        return 0;
+    }
+    log_debug("Cache hit\n");
+    metrics_add(M_HITS, 1);
     //write back to client
-    if (rio_writen(connfd_client, cached_obj->data, cached_obj->size) < 0) {
-        printf("Error occured when trying to write to client\n");
-        if(errno == EPIPE) {
-            Close(connfd_client);
-            printf("Error occured when trying to write to client\n");
+    ssize_t sent;
+    int accept_gzip = 0;
+    if (cached_obj->encoding == CB_GZIP) {
+        char accept_encoding[MAXLINE];
+        accept_gzip = http_header_value(client_hdrs, strlen(client_hdrs),
+                "Accept-Encoding", accept_encoding, MAXLINE) &&
+                http_token_match(accept_encoding, "gzip");
+    }
+    int not_modified = (range == NULL) &&
+                       head_not_modified(client_hdrs, cached_obj);
+    if (head || not_modified) {
+        sent = head_serve(cached_obj, connfd_client, accept_gzip,
+                          not_modified);
+    }
+    else if (range && cached_obj->encoding == CB_GZIP) {
+        unsigned raw_size;
+        char *raw = compress_expand(cached_obj, &raw_size);
+        sent = raw ? range_serve(connfd_client, raw, raw_size, range) : -1;
+        if (raw) {
+            Free(raw);
         }
     }
+    else if (range) {
+        sent = range_serve(connfd_client, cached_obj->data,
+                           cached_obj->size, range);
+    }
+    else if (cached_obj->encoding == CB_GZIP) {
+        sent = compress_serve(cached_obj, connfd_client, accept_gzip);
+    }
+    else {
+        sent = rio_writen(connfd_client, cached_obj->data, cached_obj->size);
+    }
+    if (sent < 0) {
+        log_warn("Error occured when trying to write to client\n");
+    }
+    else {
+        metrics_add(M_BYTES_SERVED, sent);
+    }
+    cache_release(mycache, cached_obj);
+    return 1;
 }
 /* doit
- * called within doit_thread
+ * called within worker_thread
  */
 void doit(int connfd_client) {
-    char client_request_buf[MAXLINE], method[MAXLINE], uri[MAXLINE];
-    rio_t rio_client;
-    int is_cached = 0;
-    char version[MAXLINE];
+    riob_t rio_client;
+    AR *arena = arena_get();
+    riob_init(&rio_client, connfd_client, CLIENT_BUF_INIT, RIOB_MAXSIZE);
+    serve_request(connfd_client, &rio_client, arena);
+    riob_free(&rio_client);
+    arena_put(arena);
+}
+/* serve_request
+ * reads a request from the client, and answers it
+ * the buffers of the request come from arena, not from the stack
+ */
+void serve_request(int connfd_client, riob_t *rio_client, AR *arena) {
+    char *client_request_buf = arena_alloc(arena, MAXLINE);
+    char *method = arena_alloc(arena, MAXLINE);
+    char *uri = arena_alloc(arena, MAXLINE);
+    char *version = arena_alloc(arena, MAXLINE);
+    char *client_hdrs = arena_alloc(arena, MAXBUF);
+    char *key = arena_alloc(arena, MAXLINE + 16);
+    char *host = arena_alloc(arena, MAXLINE);
+    char *suffix = arena_alloc(arena, MAXLINE);
+    char *header_server = arena_alloc(arena, 2 * MAXBUF);
+    char *head_key = NULL;
+    BR range_buf, *range = NULL;
     //read the request from client
-    Rio_readinitb(&rio_client, connfd_client);
-    if (Rio_readlineb(&rio_client, client_request_buf, MAXLINE) < 0) {
-        Close(connfd_client);
-        unix_error("Rio_readn ECONNRESET error");
-    }
-    sscanf(client_request_buf, "%s %s %s", method, uri, version);
-    //check if the method is get
-    if (strcmp(method, "GET") != 0) {
+    //errors end this request only: the caller closes the connection
+    if (riob_readlineb(rio_client, client_request_buf, MAXLINE) <= 0) {
+        log_debug("Client closed the connection before sending a request\n");
+        return;
+    }
+    unsigned long t_start = metrics_now_ns(), t_phase;
+    if (sscanf(client_request_buf, "%s %s %s", method, uri, version) != 3) {
+        clienterror(connfd_client, client_request_buf, "400", "Bad Request",
+                    "Proxy cannot parse the request line");
+        return;
+    }
+    //check if the method is get, or head
+    int head = !strcmp(method, "HEAD");
+    if (!head && strcmp(method, "GET") != 0) {
         clienterror(connfd_client, method, "501", "Not Implemented",
                     "Proxy does not implement this method");
         return;
     }
     //else, work!
-    is_cached = cache_check(mycache, uri);
-    //cache hit
-    if (is_cached) {
-        serve_cached(mycache, uri, connfd_client);
+    if (read_client_headers(rio_client, client_hdrs, MAXBUF) < 0) {
+        return;
+    }
+    //parse the required information from uri
+    int port_server = parse_uri(uri, host, suffix);
+    if (port_server < 0) {
+        clienterror(connfd_client, uri, "400", "Bad Request",
+                    "Proxy cannot parse the uri");
+        return;
+    }
+    //config the header to server, which also selects the cached variant
+    if (config_header_server(client_hdrs, header_server, 2 * MAXBUF,
+                             method, host, suffix) < 0) {
+        clienterror(connfd_client, uri, "400", "Bad Request",
+                    "The request headers are too large");
+        return;
+    }
+    if (http_normalize_uri(uri, key, MAXLINE + 16, sort_query) < 0) {
+        strcpy(key, uri);
+    }
+    if (head) {
+        //a HEAD response is cached apart from the object
+        head_key = arena_alloc(arena, MAXLINE + 32);
+        sprintf(head_key, "%s%s", HEAD_KEY_PREFIX, key);
+    }
+    else if (range_parse(client_hdrs, &range_buf)) {
+        range = &range_buf;
+    }
+    t_phase = metrics_now_ns();
+    metrics_phase(PH_PARSE, t_phase - t_start);
+    if (serve_cached(mycache, key, header_server, client_hdrs, range,
+                     head, connfd_client) ||
+            (head && serve_cached(mycache, head_key, header_server,
+                                  client_hdrs, NULL, 1, connfd_client))) {
+        unsigned long t_end = metrics_now_ns();
+        metrics_phase(PH_CACHE, t_end - t_phase);
+        metrics_phase(PH_TOTAL, t_end - t_start);
     }
     //cache miss
     else {
         //serve uncached
-        printf("Cache miss\n");
-        //parse the required information from uri
-        char host[MAXLINE], suffix[MAXLINE];
-        int port_server = parse_uri(uri, host, suffix);
+        log_debug("Cache miss\n");
+        metrics_add(M_MISSES, 1);
         if (((port_server < 1000) || (port_server > 65535))
                 && (port_server != 80)) {
-            printf("Invalid port, please specify one within 1000~65535\n");
-            exit(0);
+            clienterror(connfd_client, uri, "400", "Bad Request",
+                        "Invalid port, please specify one within 1000~65535");
+            return;
+        }
+        //shed the miss if the origin cannot take more fetches
+        if (admission && !admit_acquire(admission)) {
+            metrics_add(M_SHED, 1);
+            clienterror(connfd_client, "GET", "503", "Service Unavailable",
+                        "The origin server is overloaded, try again later");
+            return;
+        }
+        //try to connect to the server, or with -P to the owner of the key
+        unsigned long fetch_start = metrics_now_ns();
+        struct addrinfo *addlist;
+        char *peer_buf = NULL;
+        char *request = header_server;
+        PN *owner;
+        int server_fd = -1;
+        if (peers && !head && !peer_forwarded(client_hdrs) &&
+                (owner = peer_owner(peers, key)) != NULL &&
+                (peer_buf = arena_alloc(arena, 2 * MAXBUF + MAXLINE)) &&
+                peer_request(peers, client_hdrs, host, port_server, suffix,
+                             peer_buf, 2 * MAXBUF + MAXLINE) > 0 &&
+                (server_fd = peer_connect(owner)) >= 0) {
+            metrics_add(M_PEER_FETCHES, 1);
+            request = peer_buf;
+            t_phase = fetch_start;
         }
-        //try to connect to the server
-        int server_fd;
-        if ((server_fd = open_clientfd_r(host, port_server)) < 0) {
+        else if (resolve_host_r(host, port_server, &addlist) == 0) {
+            t_phase = metrics_now_ns();
+            metrics_phase(PH_DNS, t_phase - fetch_start);
+            server_fd = connect_addrinfo(addlist);
+            freeaddrinfo(addlist);
+        }
+        if (server_fd < 0) {
+            if (admission) {
+                admit_release(admission, 0, 1);
+            }
             clienterror(connfd_client, "GET", "999", "Cannot connect to server",
                         "Note that the return number is not standard");
-            Close(connfd_client);
             return;
         }
-        //config the header to server and try to foward the header to server
-        char header_server[MAXLINE];
-        rio_t rio_server;
-        config_header_server(&rio_client, header_server, host, suffix);
-        if (rio_writen(server_fd, header_server, strlen(header_server)) < 0) {
-            if (errno == EPIPE) {
-                printf("Error occured when sending data to server\n");
-                Close(server_fd);
-                return;
+        metrics_phase(PH_CONNECT, metrics_now_ns() - t_phase);
+        //try to foward the header to server
+        if (rio_writen(server_fd, request, strlen(request)) < 0) {
+            log_warn("Error occured when sending data to server\n");
+            if (admission) {
+                admit_release(admission, 0, 1);
             }
+            clienterror(connfd_client, "GET", "502", "Bad Gateway",
+                        "Proxy cannot send the request to the server");
+            close(server_fd);
+            return;
         }
+        //wait for the response to start; a hung origin is a failure
+        t_phase = metrics_now_ns();
+        if (rio_wait_fd_timeout(server_fd, POLLIN,
+                                FIRST_BYTE_TIMEOUT_MS) < 0) {
+            log_warn("No response from the server: %s\n", strerror(errno));
+            if (admission) {
+                admit_release(admission, 0, 1);
+            }
+            clienterror(connfd_client, "GET", "504", "Gateway Timeout",
+                        "The server did not answer in time");
+            close(server_fd);
+            return;
+        }
+        unsigned long t_first = metrics_now_ns();
+        metrics_phase(PH_FIRST_BYTE, t_first - t_phase);
         //read from server, write to client and buffer
-        Rio_readinitb(&rio_server, server_fd);
-        char object_buf[MAX_OBJECT_SIZE];
-        int n = 0;
-        int size = 0;
-        char buf[MAXLINE];
-        while ((n = Rio_readlineb(&rio_server, buf, MAXLINE)) != 0) {
-            if (size+n <= MAX_OBJECT_SIZE) {
+        RY relay_server;
+        relay_init(&relay_server, server_fd, connfd_client);
+        //the object buffer grows on demand up to the cache's object limit
+        char *object_buf = NULL;
+        size_t object_cap = 0;
+        ssize_t n = 0;
+        size_t size = 0;
+        char *buf;
+        //a range request is answered once the whole object is buffered,
+        //unless the object turns out too big to cache
+        int relay = (range == NULL);
+        //once the client is gone, the object is still read to be cached
+        int client_ok = 1;
+        //the headers are held back until complete, and a chunked body is
+        //decoded on the way (see chunked.c); at the end, what is held
+        //back is let go; a response to HEAD has no body to decode
+        CK chunked;
+        int eof = 0;
+        chunked_init(&chunked);
+        while (!eof && (n = relay_recv(&relay_server, &buf)) >= 0) {
+            eof = (n == 0);
+            if (!head) {
+                n = chunked_filter(&chunked, buf, n, &buf);
+            }
+            if (n <= 0) {
+                if (n < 0) {
+                    break;
+                }
+                continue;
+            }
+            if (!relay && size+n > mycache->max_object_size) {
+                relay = 1;
+                if (size > 0 &&
+                        rio_writen(connfd_client, object_buf, size) < 0) {
+                    log_warn("Error occured when sending data to client\n");
+                    client_ok = 0;
+                }
+                else {
+                    metrics_add(M_BYTES_SERVED, size);
+                }
+            }
+            if (size+n <= mycache->max_object_size) {
+                if (size+n > object_cap) {
+                    object_cap = object_cap ? 2 * object_cap : OBJECT_BUF_INIT;
+                    while (object_cap < size+n) {
+                        object_cap *= 2;
+                    }
+                    if (object_cap > mycache->max_object_size) {
+                        object_cap = mycache->max_object_size;
+                    }
+                    object_buf = Realloc(object_buf, object_cap);
+                }
                 memcpy(object_buf + size, buf, n);
-                size += n;
             }
+            size += n;
             //forward the object to client
-            if (rio_writen(connfd_client, buf, n) < 0) {
-                printf("Error occured when sending data to client\n");
+            if (relay && client_ok) {
+                if (relay_send(&relay_server, buf, n) < 0) {
+                    log_warn("Error occured when sending data to client\n");
+                    client_ok = 0;
+                }
+                else {
+                    metrics_add(M_BYTES_SERVED, n);
+                }
+            }
+        }
+        if (n < 0) {
+            //a truncated object is neither cached nor answered as a range
+            log_warn("Error occured when reading data from server\n");
+            if (!relay || size == 0) {
+                clienterror(connfd_client, "GET", "502", "Bad Gateway",
+                            "Proxy lost the connection to the server");
+                relay = 1;
+            }
+            size = mycache->max_object_size + 1;
+        }
+        //the slot is held until the object is read, so slow bodies count
+        if (admission) {
+            admit_release(admission, t_first - fetch_start, n < 0);
+        }
+        //a decoded object is cached and sliced with its length
+        if (size <= mycache->max_object_size && chunked_decoded(&chunked)) {
+            char *stored = chunked_store(&chunked, object_buf, size, &size);
+            Free(object_buf);
+            object_buf = stored;
+        }
+        chunked_free(&chunked);
+        metrics_origin_latency(metrics_now_ns() - fetch_start);
+        if (!relay) {
+            ssize_t sent = range_serve(connfd_client, object_buf, size, range);
+            if (sent < 0) {
+                log_warn("Error occured when sending data to client\n");
+            }
+            else {
+                metrics_add(M_BYTES_SERVED, sent);
+            }
+        }
+        unsigned long t_end = metrics_now_ns();
+        metrics_phase(PH_RELAY, t_end - t_first);
+        metrics_phase(PH_TOTAL, t_end - t_start);
+        //the owner of the key caches it for the other proxies
+        if (head) {
+            if (size > 0 && size <= mycache->max_object_size &&
+                    http_header_end(object_buf, size) == size) {
+                cache_insert(mycache, head_key, header_server,
+                             object_buf, size);
+            }
+        }
+        else if (size <= mycache->max_object_size &&
+                 request == header_server) {
+            log_debug("This object is not too big\n");
+            cache_insert(mycache, key, header_server, object_buf, size);
+            if (prefetcher) {
+                prefetch_page(prefetcher, uri, client_hdrs, object_buf, size);
             }
-            memset(buf, 0, strlen(buf));
         }
-        if (size <= MAX_OBJECT_SIZE) {
-            printf("This object is not too big\n");
-            cache_insert(mycache, uri, object_buf, size);
+        if (object_buf) {
+            Free(object_buf);
+        }
+        close(server_fd);
+    }
+}
+/* prefetch_fetch
+ * fetches an object for prefetch_object, and caches it if complete
+ */
+static void prefetch_fetch(char *key, char *header_server,
+                           char *host, int port_server) {
+    if (admission && !admit_acquire(admission)) {
+        return;
+    }
+    unsigned long fetch_start = metrics_now_ns();
+    int server_fd = open_clientfd_r(host, port_server);
+    if (server_fd < 0 ||
+            rio_writen(server_fd, header_server, strlen(header_server)) < 0) {
+        if (admission) {
+            admit_release(admission, 0, 1);
+        }
+        if (server_fd >= 0) {
+            close(server_fd);
+        }
+        return;
+    }
+    //a hung origin is a failure, as for a relayed fetch
+    if (rio_wait_fd_timeout(server_fd, POLLIN, FIRST_BYTE_TIMEOUT_MS) < 0) {
+        if (admission) {
+            admit_release(admission, 0, 1);
+        }
+        close(server_fd);
+        return;
+    }
+    unsigned long t_first = metrics_now_ns();
+    //the headers are looked at in the reader's buffer: with a
+    //Content-Length, the object buffer is sized once and the body is read
+    //straight into it by riob_readnb, and a body too big to cache is not
+    //read at all
+    size_t object_cap = OBJECT_BUF_INIT, size = 0, cnt, hdr_size = 0;
+    char *data, value[MAXLINE];
+    riob_t rio_server;
+    riob_init(&rio_server, server_fd, CLIENT_BUF_INIT, RIOB_MAXSIZE);
+    while ((data = riob_peek(&rio_server, &cnt)) != NULL && cnt > 0 &&
+           (hdr_size = http_header_end(data, cnt)) == 0 &&
+           riob_fill(&rio_server) > 0) {
+        ;
+    }
+    if (hdr_size && http_header_value(data, hdr_size, "Content-Length",
+                                      value, MAXLINE)) {
+        unsigned long length = strtoul(value, NULL, 10);
+        if (length > mycache->max_object_size ||
+                hdr_size + length > mycache->max_object_size) {
+            size = mycache->max_object_size + 1;
+        }
+        else {
+            object_cap = hdr_size + length + 1;  /* and one to see EOF */
+        }
+    }
+    //read the whole object, unless it is too big to cache
+    char *object_buf = Malloc(object_cap);
+    ssize_t n = 0;
+    while (size <= mycache->max_object_size &&
+           (n = riob_readnb(&rio_server, object_buf + size,
+                            object_cap - size)) > 0) {
+        size += n;
+        if (size == object_cap) {
+            object_cap *= 2;
+            object_buf = Realloc(object_buf, object_cap);
+        }
+    }
+    riob_free(&rio_server);
+    close(server_fd);
+    if (admission) {
+        admit_release(admission, t_first - fetch_start, n < 0);
+    }
+    //a chunked object is decoded as a relayed one is
+    CK chunked;
+    char *plain, *stored = NULL;
+    chunked_init(&chunked);
+    if (n == 0 && size <= mycache->max_object_size &&
+            (n = chunked_filter(&chunked, object_buf, size, &plain)) > 0 &&
+            chunked_filter(&chunked, NULL, 0, &stored) == 0) {
+        size = n;
+        stored = chunked_decoded(&chunked) ?
+                 chunked_store(&chunked, plain, size, &size) : NULL;
+        if (http_status(plain, chunked.hdr_size) == 200) {
+            cache_insert(mycache, key, header_server,
+                         stored ? stored : plain, size);
+            metrics_add(M_PREFETCHES, 1);
+        }
+        if (stored) {
+            Free(stored);
         }
-        Close(server_fd);
     }
+    chunked_free(&chunked);
+    Free(object_buf);
+}
+/* prefetch_object
+ * the prefetcher's fetch: caches the object at uri, as if the client
+ * with headers client_hdrs had asked for it, unless it is cached
+ * already or owned by a peer
+ */
+void prefetch_object(char *uri, char *client_hdrs) {
+    AR *arena = arena_get();
+    char *host = arena_alloc(arena, MAXLINE);
+    char *suffix = arena_alloc(arena, MAXLINE);
+    char *key = arena_alloc(arena, MAXLINE + 16);
+    char *header_server = arena_alloc(arena, 2 * MAXBUF);
+    int port_server = parse_uri(uri, host, suffix);
+    if (port_server >= 0 &&
+            config_header_server(client_hdrs, header_server, 2 * MAXBUF,
+                                 "GET", host, suffix) == 0) {
+        if (http_normalize_uri(uri, key, MAXLINE + 16, sort_query) < 0) {
+            strcpy(key, uri);
+        }
+        if (!cache_check(mycache, key, header_server) &&
+                !(peers && peer_owner(peers, key))) {
+            prefetch_fetch(key, header_server, host, port_server);
+        }
+    }
+    arena_put(arena);
+}
+/* signal_thread
+ * the other threads block the signals below, and this thread
+ * handles them synchronously, so it is free to take the cache mutex
+ */
+void *signal_thread(void *vargp) {
+    sigset_t *mask = (sigset_t *)vargp;
+    int sig;
+    Pthread_detach(pthread_self());
+    while (1) {
+        if (sigwait(mask, &sig) != 0) {
+            continue;
+        }
+        if (sig == SIGUSR2) {
+            metrics_dump_phases();
+            continue;
+        }
+        if (snapshot_path &&
+                cache_snapshot_save(mycache, snapshot_path) < 0) {
+            fprintf(stderr, "Error: cannot save snapshot %s\n",
+                    snapshot_path);
+        }
+        if (sig != SIGUSR1) {
+            log_flush();
+            exit(0);
+        }
+    }
+    return NULL;
+}
+/* usage
+ * prints the command line options and quits
+ */
+void usage(char *prog) {
+    fprintf(stderr, "usage: %s [-c cachesize] [-o objectsize] "
+            "[-e lru|fifo] [-z] [-q] [-d diskcache] [-D disksize] "
+            "[-s snapshot] [-m metricsport] [-w workers] "
+            "[-r rate[:burst]] [-a maxfetches] [-R] [-E uring|rio] "
+            "[-C conns] [-S shmname] [-P self,peer,...] [-p budget] "
+            "<port>\n", prog);
+    exit(0);
 }
 /* main function
  * the main routine
- * featuring figure 12.14, CSAPP 2e
+ * featuring figures 12.14 and 12.28, CSAPP 2e
  */
 int main(int argc, char **argv) {
-    int listenfd, *connfdp, port_client;
-    struct sockaddr_in clientaddr;
-    socklen_t clientlen = sizeof(clientaddr);
+    int listenfd, connfd, port_client;
+    unsigned addr;
     pthread_t tid;
+    char *disk_path = NULL;
+    char *shm_name = NULL;
+    off_t disk_size = DISK_CACHE_SIZE;
+    size_t cache_size = MAX_CACHE_SIZE;
+    size_t object_size = MAX_OBJECT_SIZE;
+    int compress = 0;
+    int policy = CACHE_LRU;
+    int metrics_port = 0;
+    int workers = 0;
+    int coroutines = 0;
+    int admit_max = -1;
+    int prefetch_budget = 0;
+    unsigned rate = 0, burst = 0;
+    RL *limiter = NULL;
+    FQ *queue;
+    int reuseport = 0;
+    cpu_set_t cpus;
+    int opt, i, cpu;
+    static sigset_t mask;
 
-    mycache = cache_create_new_cache();
-
-    if (argc != 2) {
-        fprintf(stderr, "usage: %s <port>\n", argv[0]);
+    while ((opt = getopt(argc, argv,
+                         "c:o:e:zqd:D:s:m:w:r:a:RE:C:S:P:p:")) != -1) {
+        switch (opt) {
+        case 'c':
+            if ((cache_size = cache_parse_size(optarg)) == 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'o':
+            if ((object_size = cache_parse_size(optarg)) == 0 ||
+                    object_size > CACHE_OBJECT_LIMIT) {
+                usage(argv[0]);
+            }
+            break;
+        case 'e':
+            if ((policy = cache_parse_policy(optarg)) < 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'z':
+            compress = 1;
+            break;
+        case 'q':
+            sort_query = 1;
+            break;
+        case 'd':
+            disk_path = optarg;
+            break;
+        case 'D':
+            if ((disk_size = cache_parse_size(optarg)) == 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 's':
+            snapshot_path = optarg;
+            break;
+        case 'S':
+            shm_name = optarg;
+            break;
+        case 'p':
+            if ((prefetch_budget = atoi(optarg)) <= 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'P':
+            if ((peers = peer_ring_create(optarg)) == NULL) {
+                fprintf(stderr, "Error: cannot use peers %s\n", optarg);
+                exit(0);
+            }
+            break;
+        case 'm':
+            if ((metrics_port = atoi(optarg)) <= 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'w':
+            if ((workers = atoi(optarg)) <= 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'r':
+            if (sscanf(optarg, "%u:%u", &rate, &burst) < 1 || rate == 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'a':
+            if ((admit_max = atoi(optarg)) < 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'R':
+            reuseport = 1;
+            break;
+        case 'C':
+            if ((coroutines = atoi(optarg)) <= 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'E':
+            if (!strcmp(optarg, "rio")) {
+                relay_set_engine(0);
+            }
+            else if (strcmp(optarg, "uring")) {
+                usage(argv[0]);
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+    }
+    //the options are checked before any cache tier is opened
+    if (shm_name && (disk_path || snapshot_path)) {
+        fprintf(stderr, "Error: -S cannot be used with -d or -s\n");
+        exit(0);
+    }
+    mycache = cache_create_new_cache(cache_size, object_size);
+    mycache->compress = compress;
+    mycache->policy = policy;
+    if (disk_path &&
+            (mycache->disk = disk_cache_open(disk_path, disk_size)) == NULL) {
+        fprintf(stderr, "Error: cannot open disk cache %s\n", disk_path);
+        exit(0);
+    }
+    if (shm_name &&
+            (mycache->shm = shm_cache_open(shm_name, cache_size)) == NULL) {
+        fprintf(stderr, "Error: cannot open shared cache %s\n", shm_name);
         exit(0);
     }
 
-    port_client = atoi(argv[1]);
+    if (snapshot_path) {
+        cache_snapshot_load(mycache, snapshot_path);
+    }
+
+    port_client = atoi(argv[optind]);
     Signal(SIGPIPE, SIG_IGN);
 
-    if ((listenfd = Open_listenfd(port_client)) < 0) {
+    //block the signals handled by signal_thread in every thread
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGUSR1);
+    Sigaddset(&mask, SIGUSR2);
+    Sigaddset(&mask, SIGINT);
+    Sigaddset(&mask, SIGTERM);
+    Sigprocmask(SIG_BLOCK, &mask, NULL);
+    Pthread_create(&tid, NULL, signal_thread, &mask);
+    log_start();
+    if (metrics_port) {
+        metrics_start(metrics_port, mycache);
+    }
+
+    if (rate) {
+        limiter = rl_create(rate, burst ? burst : 2 * rate);
+    }
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) < 0) {
+        unix_error("sched_getaffinity error");
+    }
+    if (workers == 0) {
+        workers = coroutines ? CPU_COUNT(&cpus) : PROXY_WORKERS;
+    }
+    if (admit_max < 0) {
+        admit_max = (workers * (coroutines ? coroutines : 1) * 3 + 3) / 4;
+    }
+    if (admit_max > 0) {
+        admission = admit_create(admit_max);
+    }
+    if (prefetch_budget) {
+        prefetcher = prefetch_create(prefetch_budget, prefetch_object);
+    }
+
+    if (!reuseport && (listenfd = Open_listenfd(port_client)) < 0) {
         fprintf(stderr, "Error: open_listenfd\n");
         exit(0);
     }
+    if (reuseport || coroutines) {
+        for (i = 0, cpu = -1; i < workers; i++) {
+            LA *args = Malloc(sizeof(LA));
+            args->listenfd = listenfd;
+            args->cpu = -1;
+            args->limiter = limiter;
+            args->max_conns = coroutines;
+            if (reuseport) {
+                /* spread the listeners over the cores we may run on */
+                do {
+                    cpu = (cpu + 1) % CPU_SETSIZE;
+                } while (!CPU_ISSET(cpu, &cpus));
+                args->cpu = cpu;
+                args->listenfd = open_reuseport_listenfd(port_client);
+                if (args->listenfd < 0) {
+                    unix_error("open_reuseport_listenfd error");
+                }
+            }
+            if (coroutines) {
+                fcntl(args->listenfd, F_SETFL,
+                      fcntl(args->listenfd, F_GETFL) | O_NONBLOCK);
+                Pthread_create(&tid, NULL, coroutine_thread, args);
+            }
+            else {
+                Pthread_create(&tid, NULL, listener_thread, args);
+            }
+        }
+        Pthread_exit(NULL);
+    }
+
+    queue = fq_create(FQ_SIZE, FQ_CLIENT_MAX);
+    for (i = 0; i < workers; i++) {
+        Pthread_create(&tid, NULL, worker_thread, queue);
+    }
 
     while (1) {
-        connfdp = Malloc(sizeof(int));
-        *connfdp = Accept(listenfd, (SA *) &clientaddr, &clientlen);
-        Pthread_create(&tid, NULL, doit_thread, connfdp);
+        if ((connfd = accept_client(listenfd, limiter, &addr)) < 0) {
+            continue;
+        }
+        if (fq_insert(queue, connfd, addr) < 0) {
+            reject_client(connfd);
+        }
     }
 
     return 0;
@@ -0,0 +1,142 @@
+/* range
+ * serves "Range: bytes=..." requests from complete cached responses
+ * only a single range is supported; a request for several ranges is
+ * answered with the whole response, which HTTP allows
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include "csapp.h"
+#include "http.h"
+#include "range.h"
+
+//=========================================functions
+/* range_parse
+ * looks for a single byte range in the client's request headers
+ * returns 1 if one was found, 0 otherwise
+ */
+int range_parse (char *client_hdrs, BR *range) {
+    char value[MAXLINE];
+    char *ptr, *end;
+
+    if (!http_header_value(client_hdrs, strlen(client_hdrs), "Range",
+                           value, MAXLINE) ||
+            strncasecmp(value, "bytes=", 6) || strchr(value, ',')) {
+        return 0;
+    }
+    ptr = value + 6;
+    if (*ptr == '-') {
+        range->first = -1;
+        range->last = strtoll(ptr + 1, &end, 10);
+        return (end > ptr + 1 && *end == '\0' && range->last > 0);
+    }
+    range->first = strtoll(ptr, &end, 10);
+    if (end == ptr || *end != '-' || range->first < 0) {
+        return 0;
+    }
+    ptr = end + 1;
+    if (*ptr == '\0') {
+        range->last = -1;
+        return 1;
+    }
+    range->last = strtoll(ptr, &end, 10);
+    return (*end == '\0' && range->last >= range->first);
+}
+
+/* range_resolve
+ * turns a range into the inclusive offsets [start, end] of a body of
+ * total bytes
+ * returns 0 on success, -1 if the range is not satisfiable
+ */
+int range_resolve (BR *range, size_t total, size_t *start, size_t *end) {
+    if (total == 0) {
+        return -1;
+    }
+    if (range->first < 0) {
+        *start = (range->last >= total) ? 0 : total - range->last;
+        *end = total - 1;
+        return 0;
+    }
+    if (range->first >= total) {
+        return -1;
+    }
+    *start = range->first;
+    *end = (range->last < 0 || range->last >= total) ? total - 1
+                                                     : range->last;
+    return 0;
+}
+
+/* range_headers
+ * writes the headers of a 206 response for bytes [start, end] of a body
+ * of total bytes into out: the status line, the original headers but
+ * their length fields, then Content-Range and Content-Length
+ * returns the length of the headers, or 0 if they do not fit
+ */
+size_t range_headers (char *hdrs, size_t hdr_size, size_t start, size_t end,
+                      size_t total, char *out, size_t max) {
+    char *line, *stop = hdrs + hdr_size - 2;    /* skip blank line */
+    size_t n;
+
+    line = memchr(hdrs, '\n', hdr_size);        /* skip status line */
+    line = line ? line + 1 : stop;
+    if (hdr_size + 128 > max) {    /* room for the added fields */
+        return 0;
+    }
+    n = sprintf(out, "HTTP/1.0 206 Partial Content\r\n");
+    while (line < stop) {
+        char *eol = memchr(line, '\n', stop - line);
+        eol = eol ? eol + 1 : stop;
+        if (strncasecmp(line, "Content-Length:", 15) &&
+                strncasecmp(line, "Content-Range:", 14)) {
+            memcpy(out + n, line, eol - line);
+            n += eol - line;
+        }
+        line = eol;
+    }
+    n += sprintf(out + n, "Content-Range: bytes %zu-%zu/%zu\r\n"
+                 "Content-Length: %zu\r\n\r\n",
+                 start, end, total, end - start + 1);
+    return n;
+}
+
+/* range_unsatisfiable
+ * writes a 416 response for a body of total bytes into out
+ * returns its length
+ */
+size_t range_unsatisfiable (size_t total, char *out) {
+    return sprintf(out, "HTTP/1.0 416 Range Not Satisfiable\r\n"
+                   "Content-Range: bytes */%zu\r\n"
+                   "Content-Length: 0\r\n\r\n", total);
+}
+
+/* range_serve
+ * sends the requested range of a complete response of size bytes
+ * responses other than 200 are sent whole
+ * returns the number of bytes sent, -1 on a write error
+ */
+ssize_t range_serve (int fd, char *resp, size_t size, BR *range) {
+    char hdr_buf[2 * MAXBUF];
+    size_t hdr_size = http_header_end(resp, size);
+    size_t start, end, n;
+    struct iovec iov[2];
+
+    if (hdr_size == 0 || http_status(resp, hdr_size) != 200) {
+        return rio_writen(fd, resp, size) < 0 ? -1 : size;
+    }
+    if (range_resolve(range, size - hdr_size, &start, &end) < 0) {
+        n = range_unsatisfiable(size - hdr_size, hdr_buf);
+        return rio_writen(fd, hdr_buf, n) < 0 ? -1 : n;
+    }
+    n = range_headers(resp, hdr_size, start, end, size - hdr_size,
+                      hdr_buf, sizeof(hdr_buf));
+    if (n == 0) {
+        return rio_writen(fd, resp, size) < 0 ? -1 : size;
+    }
+    iov[0].iov_base = hdr_buf;
+    iov[0].iov_len = n;
+    iov[1].iov_base = resp + hdr_size + start;
+    iov[1].iov_len = end - start + 1;
+    return rio_writevn(fd, iov, 2);
+}
@@ -0,0 +1,28 @@
+/* This header file contains the interfaces to byte range serving
+ */
+#ifndef __RANGE_H__
+#define __RANGE_H__
+
+#include "csapp.h"
+
+/* a single "Range: bytes=..." request
+ * bytes=a-b gives first=a last=b, bytes=a- gives first=a last=-1,
+ * and bytes=-n (the last n bytes) gives first=-1 last=n
+ */
+typedef struct byte_range {
+    long long first;
+    long long last;
+} BR;
+
+int range_parse (char *client_hdrs, BR *range);
+
+int range_resolve (BR *range, size_t total, size_t *start, size_t *end);
+
+size_t range_headers (char *hdrs, size_t hdr_size, size_t start, size_t end,
+                      size_t total, char *out, size_t max);
+
+size_t range_unsatisfiable (size_t total, char *out);
+
+ssize_t range_serve (int fd, char *resp, size_t size, BR *range);
+
+#endif /* __RANGE_H__ */
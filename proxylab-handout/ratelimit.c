@@ -0,0 +1,137 @@
+/* ratelimit
+ * token bucket rate limiting per client address
+ * every client gets a bucket of burst tokens, refilled at rate tokens
+ * per second, and each request takes one token
+ *
+ * the buckets live in a fixed table without locks: a client claims a
+ * slot with a compare-and-swap on its key, and a bucket is updated
+ * with a compare-and-swap on a single word holding both the tokens
+ * and the time they were counted, so accepting threads never wait on
+ * each other; the table is split in cache-line aligned shards
+ * a slot whose bucket has refilled is idle: its client would start over
+ * with a full bucket anyway, so a new client takes the slot over with a
+ * compare-and-swap on its key, and the table cannot be used up by
+ * clients that have gone; a client that finds no slot, because all the
+ * slots it may use are busy, is let through (the limiter fails open)
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include "csapp.h"
+#include "ratelimit.h"
+
+//=========================================functions
+static unsigned long rl_now_ms (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000 + 1;
+}
+
+/* rl_create
+ * returns a limiter allowing rate requests per second per client,
+ * in bursts of up to burst requests
+ */
+RL *rl_create (unsigned rate, unsigned burst) {
+    RL *limiter = Calloc(1, sizeof(RL));
+    if (burst == 0) {
+        burst = 1;
+    }
+    limiter->rate = rate;
+    limiter->burst = (burst > RL_MAX_BURST) ? RL_MAX_BURST : burst;
+    return limiter;
+}
+
+/* rl_idle
+ * checks if a bucket state has refilled to a full bucket by time now
+ */
+static int rl_idle (RL *limiter, unsigned long state, unsigned long now) {
+    unsigned long full = (unsigned long)limiter->burst * RL_SCALE;
+    unsigned long then = state >> 24;
+    unsigned long tokens = state & ((1 << 24) - 1);
+    if (state == 0 || tokens >= full) {
+        return 1;
+    }
+    return now > then && (now - then) * limiter->rate >= full - tokens;
+}
+
+/* rl_slot
+ * finds the slot of a client address, or claims a free or idle one
+ * the client's own slot is looked for first, so that it never gets a
+ * second bucket
+ * returns NULL if the client has none and none is free or idle
+ */
+static RS *rl_slot (RL *limiter, unsigned addr, unsigned long now) {
+    unsigned hash = addr * 0x9e3779b1U;
+    RSH *shard = &limiter->shard[hash >> 28 & (RL_SHARDS - 1)];
+    unsigned key = addr + 1, cur, i;
+    RS *slot;
+
+    if (key == 0) {
+        key = 1;        /* 255.255.255.255 shares a slot with 0.0.0.0 */
+    }
+    for (i = 0; i < RL_PROBES; i++) {
+        slot = &shard->slot[(hash + i) & (RL_SHARD_SLOTS - 1)];
+        if (atomic_load_explicit(&slot->key, memory_order_acquire) == key) {
+            return slot;
+        }
+    }
+    for (i = 0; i < RL_PROBES; i++) {
+        slot = &shard->slot[(hash + i) & (RL_SHARD_SLOTS - 1)];
+        cur = atomic_load_explicit(&slot->key, memory_order_acquire);
+        /* the state of an idle slot reads as a full bucket, and is kept */
+        if ((cur == 0 || rl_idle(limiter, atomic_load_explicit(&slot->state,
+                                     memory_order_relaxed), now)) &&
+                atomic_compare_exchange_strong(&slot->key, &cur, key)) {
+            return slot;
+        }
+        if (cur == key) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/* rl_allow
+ * takes a token from the bucket of a client address
+ * returns 1 if the request may go on, 0 if the client is over its rate
+ */
+int rl_allow (RL *limiter, unsigned addr) {
+    unsigned long now = rl_now_ms();
+    RS *slot = rl_slot(limiter, addr, now);
+    unsigned long full = (unsigned long)limiter->burst * RL_SCALE;
+    unsigned long old, new, tokens, stamp;
+    int allowed;
+
+    if (slot == NULL) {
+        return 1;
+    }
+    old = atomic_load_explicit(&slot->state, memory_order_relaxed);
+    do {
+        stamp = now;
+        if (old == 0) {
+            tokens = full;
+        }
+        else {
+            unsigned long then = old >> 24;
+            tokens = old & ((1 << 24) - 1);
+            if (now > then) {
+                /* rate tokens per second are rate thousandths per ms */
+                tokens += (now - then) * limiter->rate;
+            }
+            else {
+                stamp = then;   /* updated by a later clock reading */
+            }
+            if (tokens > full) {
+                tokens = full;
+            }
+        }
+        allowed = (tokens >= RL_SCALE);
+        if (allowed) {
+            tokens -= RL_SCALE;
+        }
+        new = (stamp << 24) | tokens;
+    } while (!atomic_compare_exchange_weak(&slot->state, &old, new));
+    return allowed;
+}
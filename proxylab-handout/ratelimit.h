@@ -0,0 +1,38 @@
+/* This header file contains the interfaces to per-client rate limiting
+ */
+#ifndef __RATELIMIT_H__
+#define __RATELIMIT_H__
+
+#include <stdatomic.h>
+#include "csapp.h"
+
+#define RL_SHARDS 16            /* a power of 2 */
+#define RL_SHARD_SLOTS 1024     /* a power of 2 */
+#define RL_PROBES 8             /* slots looked at before failing open */
+#define RL_SCALE 1000           /* tokens are counted in thousandths */
+#define RL_MAX_BURST ((1 << 24) / RL_SCALE - 1)
+
+/* the token bucket of a client address
+ * state packs the time of the last update in milliseconds (high bits)
+ * and the tokens left, in thousandths (low 24 bits); 0 means full
+ */
+typedef struct rate_slot {
+    atomic_uint key;            /* address + 1, 0 while the slot is free */
+    atomic_ulong state;
+} RS;
+
+typedef struct rate_shard {
+    RS slot[RL_SHARD_SLOTS];
+} __attribute__((aligned(64))) RSH;
+
+typedef struct rate_limiter {
+    unsigned rate;              /* tokens added per second */
+    unsigned burst;             /* bucket size */
+    RSH shard[RL_SHARDS];
+} RL;
+
+RL *rl_create (unsigned rate, unsigned burst);
+
+int rl_allow (RL *limiter, unsigned addr);
+
+#endif /* __RATELIMIT_H__ */
@@ -0,0 +1,210 @@
+/* relay
+ * copies a response from the server to the client in chunks
+ * with io_uring (see ioengine.c), sending a chunk to the client and
+ * receiving the next one from the server are submitted together, so
+ * the two run at the same time and cost one system call instead of two
+ * the chunks live in two buffers per thread, registered with the
+ * thread's engine once, which the kernel does not map again per call
+ *
+ * where io_uring is unavailable, or disabled with relay_set_engine,
+ * the relay reads and writes with blocking calls into a buffer of its
+ * own; so do coroutines (see coro.c), which must not block their thread
+ * in the engine, and share the thread with other relays
+ *
+ * if the engine itself fails, the relay it was in ends with an error,
+ * and the thread drops the engine and relays with blocking calls from
+ * then on; the other connections are not affected
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include "csapp.h"
+#include "ioengine.h"
+#include "relay.h"
+#include "log.h"
+
+/* tags of the two operations in flight */
+#define RELAY_TAG_RECV ((void *)1)
+#define RELAY_TAG_SEND ((void *)2)
+
+static int relay_engine_enabled = 1;
+/* per thread: the chunk buffers, and the engine they are registered with */
+static __thread int relay_thread_ready;
+static __thread char *relay_buf;
+static __thread IOE *relay_engine;
+
+//=========================================functions
+/* relay_set_engine
+ * chooses between io_uring and blocking calls, before the workers start
+ */
+void relay_set_engine (int enabled) {
+    relay_engine_enabled = enabled;
+}
+
+/* relay_thread_init
+ * sets up the calling thread's buffers and engine, the first time
+ */
+static void relay_thread_init (void) {
+    struct iovec iov;
+    relay_thread_ready = 1;
+    if (!relay_engine_enabled || (relay_engine = ioe_create(4)) == NULL) {
+        return;
+    }
+    relay_buf = Malloc(2 * RELAY_CHUNK);
+    iov.iov_base = relay_buf;
+    iov.iov_len = 2 * RELAY_CHUNK;
+    if (ioe_register_buffers(relay_engine, &iov, 1) < 0) {
+        /* over RLIMIT_MEMLOCK, say; plain buffers work as well */
+        log_debug("relay: cannot register buffers\n");
+    }
+}
+
+/* relay_init
+ * starts relaying from server_fd to client_fd
+ */
+void relay_init (RY *relay, int server_fd, int client_fd) {
+    if (rio_has_wait_hook()) {
+        relay->engine = NULL;
+    }
+    else {
+        if (!relay_thread_ready) {
+            relay_thread_init();
+        }
+        relay->engine = relay_engine;
+    }
+    relay->server_fd = server_fd;
+    relay->client_fd = client_fd;
+    if (relay->engine) {
+        relay->chunk[0] = relay_buf;
+        relay->chunk[1] = relay_buf + RELAY_CHUNK;
+    }
+    else {
+        relay->chunk[0] = relay->chunk[1] = relay->buf;
+    }
+    relay->cur = 1;
+    relay->received = RELAY_NONE;
+}
+
+/* relay_wait
+ * waits for one completion of the relay's engine
+ * returns 0, or -1 with errno set if the engine failed
+ */
+static int relay_wait (RY *relay, IOC *done) {
+    int cnt;
+    while ((cnt = ioe_wait(relay->engine, done, 1, 1)) == 0) {
+        ;
+    }
+    return (cnt < 0) ? -1 : 0;
+}
+
+/* relay_drop_engine
+ * gives up the thread's engine after it failed, so that the thread
+ * relays with blocking calls; the relay is left failed, since an
+ * operation in flight may have taken bytes from the server
+ * the chunk buffers are not freed: the kernel may still complete an
+ * operation into them while it tears the ring down
+ */
+static void relay_drop_engine (RY *relay) {
+    int err = errno ? errno : EIO;
+    log_warn("relay: io_uring failed (%s), using blocking calls\n",
+             strerror(err));
+    ioe_destroy(relay_engine);
+    relay_engine = NULL;
+    relay->engine = NULL;
+    relay->chunk[0] = relay->chunk[1] = relay->buf;
+    relay->received = -err;
+    errno = err;
+}
+
+/* relay_recv
+ * receives the next chunk from the server, and points chunk at it
+ * the chunk is valid until the next call
+ * returns its length, 0 at the end of the response, -1 on error
+ */
+ssize_t relay_recv (RY *relay, char **chunk) {
+    ssize_t n;
+    IOC done;
+    relay->cur ^= 1;
+    *chunk = relay->chunk[relay->cur];
+    if (relay->received != RELAY_NONE) {
+        n = relay->received;
+        relay->received = RELAY_NONE;
+    }
+    else if (relay->engine) {
+        if (ioe_recv(relay->engine, relay->server_fd, *chunk, RELAY_CHUNK,
+                     RELAY_TAG_RECV) < 0 || relay_wait(relay, &done) < 0) {
+            relay_drop_engine(relay);
+            return -1;
+        }
+        n = done.res;
+    }
+    else {
+        while ((n = read(relay->server_fd, *chunk, RELAY_CHUNK)) < 0) {
+            if (errno == EAGAIN) {  /* a coroutine's non-blocking socket */
+                if (rio_wait_fd(relay->server_fd, POLLIN) < 0) {
+                    return -1;
+                }
+            }
+            else if (errno != EINTR) {
+                return -1;
+            }
+        }
+        return n;
+    }
+    if (n < 0) {
+        errno = -n;
+        return -1;
+    }
+    return n;
+}
+
+/* relay_send
+ * sends the n bytes at chunk, which relay_recv returned, to the client,
+ * while the next chunk is received from the server
+ * returns n, or -1 on error
+ */
+ssize_t relay_send (RY *relay, char *chunk, size_t n) {
+    size_t sent = 0;
+    int pending = 2, err = 0;
+    IOC done;
+    if (relay->engine == NULL) {
+        return rio_writen(relay->client_fd, chunk, n);
+    }
+    if (ioe_send(relay->engine, relay->client_fd, chunk, n,
+                 RELAY_TAG_SEND) < 0 ||
+            ioe_recv(relay->engine, relay->server_fd,
+                     relay->chunk[relay->cur ^ 1], RELAY_CHUNK,
+                     RELAY_TAG_RECV) < 0) {
+        relay_drop_engine(relay);
+        return -1;
+    }
+    while (pending > 0) {
+        if (relay_wait(relay, &done) < 0) {
+            relay_drop_engine(relay);
+            return -1;
+        }
+        pending--;
+        if (done.tag == RELAY_TAG_RECV) {
+            relay->received = done.res;
+        }
+        else if (done.res <= 0) {
+            err = done.res ? -done.res : EPIPE;
+        }
+        else if ((sent += done.res) < n) {
+            /* a short send, the rest goes out on its own */
+            if (ioe_send(relay->engine, relay->client_fd, chunk + sent,
+                         n - sent, RELAY_TAG_SEND) < 0) {
+                relay_drop_engine(relay);
+                return -1;
+            }
+            pending++;
+        }
+    }
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return n;
+}
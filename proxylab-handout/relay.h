@@ -0,0 +1,33 @@
+/* This header file contains the interfaces to the relay of a response
+ * from the server to the client
+ */
+#ifndef __RELAY_H__
+#define __RELAY_H__
+
+#include "csapp.h"
+#include "ioengine.h"
+
+#define RELAY_CHUNK 16384       /* bytes received from the server at once */
+#define RELAY_NONE (-(1L << 40)) /* no receive is done ahead */
+
+typedef struct relay {
+    IOE *engine;                /* this thread's engine, NULL if blocking */
+    int server_fd;
+    int client_fd;
+    char *chunk[2];             /* the next chunk is received into one while
+                                   the other is sent */
+    int cur;                    /* the chunk relay_recv returned last */
+    long received;              /* result of the receive done ahead into
+                                   the other chunk, or RELAY_NONE */
+    char buf[RELAY_CHUNK];      /* the only chunk without an engine */
+} RY;
+
+void relay_set_engine (int enabled);
+
+void relay_init (RY *relay, int server_fd, int client_fd);
+
+ssize_t relay_recv (RY *relay, char **chunk);
+
+ssize_t relay_send (RY *relay, char *chunk, size_t n);
+
+#endif /* __RELAY_H__ */
@@ -0,0 +1,573 @@
+/* shared memory cache
+ * holds the memory cache in a POSIX shared memory region (shm_open),
+ * so that the proxy processes of one host, started with the same name,
+ * cache every object once and hit on what any of them fetched
+ *
+ * the region holds a header, a hash index and a ring of entries, like
+ * the log of the disk cache (see disk_cache.c): an entry is appended at
+ * the tail, and the oldest entries are dropped to make room for it, so
+ * the region is used in FIFO order whatever the -e policy
+ * a process maps the region at its own address, so links are offsets
+ * from its start; one process-shared mutex guards everything
+ *
+ * a hit is served from the region in place: the entry is pinned in the
+ * slot of the process until the response is sent, and an entry that
+ * is pinned is never overwritten (the insert is dropped instead)
+ * an insert only takes the lock to reserve its room in the ring and,
+ * once the data is copied in, to index the entry; in between, the entry
+ * is pinned by its writer and not indexed, so nobody reads or reuses it
+ * the pins of a process that died are cleared when they get in the
+ * way; so is the lock, which is robust, but as the dead process may
+ * have left the index half updated, the index is emptied then
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include "csapp.h"
+#include "cache.h"
+#include "shm_cache.h"
+#include "metrics.h"
+#include "log.h"
+
+//=========================================functions
+/* shm_cache_align
+ * rounds len up to the alignment of entries
+ */
+static size_t shm_cache_align (size_t len) {
+    return (len + SHM_CACHE_ALIGN - 1) & ~(size_t)(SHM_CACHE_ALIGN - 1);
+}
+
+/* shm_cache_entry
+ * returns the entry at offset off of the region
+ */
+static SME *shm_cache_entry (SC *Shm, size_t off) {
+    return (SME *)(Shm->base + off);
+}
+
+/* shm_cache_bucket
+ * returns the hash chain of a key hash
+ */
+static size_t *shm_cache_bucket (SC *Shm, unsigned long key_hash) {
+    return &Shm->buckets[key_hash & (Shm->hdr->bucket_cnt - 1)];
+}
+
+/* shm_cache_alive
+ * checks if the process attached as pid is still running
+ */
+static int shm_cache_alive (pid_t pid) {
+    return pid != 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+/* shm_cache_recover
+ * repairs the region after a process died holding the lock
+ * an entry joins the ring with its room reserved, so the ring is
+ * followed to its real end; the index is emptied, as the dead process
+ * may have been changing it, but the entries stay in the ring with their
+ * pins, so none that is being sent is overwritten
+ * the caller must hold the lock
+ */
+static void shm_cache_recover (SC *Shm) {
+    SMH *hdr = Shm->hdr;
+    size_t off = hdr->log_head, last = 0;
+    unsigned long i;
+    while (off) {
+        SME *entry = shm_cache_entry(Shm, off);
+        entry->indexed = 0;
+        last = off;
+        off = entry->lnext;
+    }
+    hdr->log_tail = last;
+    if (last) {
+        hdr->tail = last + shm_cache_entry(Shm, last)->len;
+    }
+    for (i = 0; i < hdr->bucket_cnt; i++) {
+        Shm->buckets[i] = 0;
+    }
+    hdr->cache_size = 0;
+    hdr->entry_cnt = 0;
+}
+
+/* shm_cache_lock
+ * takes the lock of the region; when it is contended, the time spent
+ * waiting is added to the lock wait metrics
+ */
+static void shm_cache_lock (SC *Shm) {
+    pthread_mutex_t *mutex = &Shm->hdr->mutex;
+    int rc;
+    if ((rc = pthread_mutex_trylock(mutex)) == EBUSY) {
+        unsigned long start = metrics_now_ns();
+        rc = pthread_mutex_lock(mutex);
+        metrics_add(M_LOCK_WAITS, 1);
+        metrics_add(M_LOCK_WAIT_NS, metrics_now_ns() - start);
+    }
+    if (rc == EOWNERDEAD) {
+        log_info("shm cache: a process died holding the lock, "
+                 "emptying the index\n");
+        shm_cache_recover(Shm);
+        pthread_mutex_consistent(mutex);
+    }
+    else if (rc != 0) {
+        posix_error(rc, "pthread_mutex_lock error");
+    }
+}
+
+static void shm_cache_unlock (SC *Shm) {
+    pthread_mutex_unlock(&Shm->hdr->mutex);
+}
+
+/* shm_cache_reclaim
+ * frees the slot of a process that is gone, with the pins it left
+ * the caller must hold the lock
+ */
+static void shm_cache_reclaim (SC *Shm, int slot) {
+    SMH *hdr = Shm->hdr;
+    size_t off = hdr->log_head;
+    if (hdr->procs[slot] == 0) {
+        return;
+    }
+    log_info("shm cache: reclaiming the slot of process %d\n",
+             (int)hdr->procs[slot]);
+    while (off) {
+        SME *entry = shm_cache_entry(Shm, off);
+        entry->pins[slot] = 0;
+        off = entry->lnext;
+    }
+    hdr->procs[slot] = 0;
+}
+
+/* shm_cache_pinned
+ * checks if an entry is being sent by a process that is still running
+ * the caller must hold the lock
+ */
+static int shm_cache_pinned (SC *Shm, SME *entry) {
+    int i;
+    for (i = 0; i < SHM_CACHE_PROCS; i++) {
+        if (entry->pins[i] == 0) {
+            continue;
+        }
+        if (shm_cache_alive(Shm->hdr->procs[i])) {
+            return 1;
+        }
+        shm_cache_reclaim(Shm, i);
+        entry->pins[i] = 0;
+    }
+    return 0;
+}
+
+/* shm_cache_unindex
+ * removes an entry from the hash index, if it is still there
+ * the caller must hold the lock
+ */
+static void shm_cache_unindex (SC *Shm, size_t off) {
+    SME *entry = shm_cache_entry(Shm, off);
+    size_t *pp = shm_cache_bucket(Shm, entry->key_hash);
+    if (!entry->indexed) {
+        return;
+    }
+    while (*pp && *pp != off) {
+        pp = &shm_cache_entry(Shm, *pp)->hnext;
+    }
+    if (*pp) {
+        *pp = entry->hnext;
+    }
+    entry->indexed = 0;
+    Shm->hdr->cache_size -= entry->size;
+    Shm->hdr->entry_cnt--;
+}
+
+/* shm_cache_drop_oldest
+ * forgets the oldest entry in the ring
+ * the caller must hold the lock
+ */
+static void shm_cache_drop_oldest (SC *Shm) {
+    SMH *hdr = Shm->hdr;
+    size_t off = hdr->log_head;
+    if (shm_cache_entry(Shm, off)->indexed) {
+        shm_cache_unindex(Shm, off);
+        metrics_add(M_EVICTIONS, 1);
+    }
+    hdr->log_head = shm_cache_entry(Shm, off)->lnext;
+    if (hdr->log_head == 0) {
+        hdr->log_tail = 0;
+    }
+}
+
+/* shm_cache_make_room
+ * forgets the entries overlapped by an append of len bytes at the tail,
+ * wrapping to the start of the ring when its end is reached
+ * returns -1 if an entry to be overwritten is pinned
+ * the caller must hold the lock
+ */
+static int shm_cache_make_room (SC *Shm, size_t len) {
+    SMH *hdr = Shm->hdr;
+    if (hdr->tail + len > hdr->data_off + hdr->data_size) {
+        /* the entries left behind the tail are the oldest ones */
+        while (hdr->log_head && hdr->log_head >= hdr->tail) {
+            if (shm_cache_pinned(Shm, shm_cache_entry(Shm, hdr->log_head))) {
+                return -1;
+            }
+            shm_cache_drop_oldest(Shm);
+        }
+        hdr->tail = hdr->data_off;
+    }
+    while (hdr->log_head && hdr->log_head >= hdr->tail &&
+           hdr->log_head < hdr->tail + len) {
+        if (shm_cache_pinned(Shm, shm_cache_entry(Shm, hdr->log_head))) {
+            return -1;
+        }
+        shm_cache_drop_oldest(Shm);
+    }
+    return 0;
+}
+
+/* shm_cache_id, shm_cache_vary, shm_cache_data
+ * return the strings and the data stored after an entry
+ */
+static char *shm_cache_id (SME *entry) {
+    return (char *)(entry + 1);
+}
+
+static char *shm_cache_vary (SME *entry) {
+    return shm_cache_id(entry) + entry->id_len + 1;
+}
+
+static char *shm_cache_data (SME *entry) {
+    return shm_cache_vary(entry) + entry->vary_len + 1;
+}
+
+/* shm_cache_lookup
+ * returns the offset of the entry cached for key that suits a request
+ * with the headers req_hdrs, or 0
+ * the caller must hold the lock
+ */
+static size_t shm_cache_lookup (SC *Shm, char *key, char *req_hdrs) {
+    unsigned long key_hash = cache_hash(key);
+    size_t off = *shm_cache_bucket(Shm, key_hash);
+    while (off) {
+        SME *entry = shm_cache_entry(Shm, off);
+        if (entry->key_hash == key_hash && !strcmp(key, shm_cache_id(entry)) &&
+                !cache_expired(entry->expires) &&
+                (entry->vary_len == 0 || entry->vary_hash ==
+                 cache_vary_hash(shm_cache_vary(entry), req_hdrs))) {
+            return off;
+        }
+        off = entry->hnext;
+    }
+    return 0;
+}
+
+/* shm_cache_attach
+ * takes a slot for this process, reclaiming one of a process that died
+ * returns the slot, or -1 if SHM_CACHE_PROCS processes are attached
+ */
+static int shm_cache_attach (SC *Shm) {
+    SMH *hdr = Shm->hdr;
+    int i, slot = -1;
+    shm_cache_lock(Shm);
+    for (i = 0; i < SHM_CACHE_PROCS && slot < 0; i++) {
+        if (!shm_cache_alive(hdr->procs[i])) {
+            shm_cache_reclaim(Shm, i);
+            hdr->procs[i] = getpid();
+            slot = i;
+        }
+    }
+    shm_cache_unlock(Shm);
+    return slot;
+}
+
+/* shm_cache_init
+ * lays out a region of size bytes that was just created
+ * returns 0 on success, -1 if size is too small
+ */
+static int shm_cache_init (SMH *hdr, size_t size) {
+    pthread_mutexattr_t attr;
+    hdr->version = SHM_CACHE_VERSION;
+    hdr->region_size = size;
+    hdr->bucket_cnt = CACHE_MIN_BUCKETS;
+    while (hdr->bucket_cnt * CACHE_BUCKET_BYTES < size) {
+        hdr->bucket_cnt <<= 1;
+    }
+    hdr->data_off = shm_cache_align(sizeof(SMH)) +
+                    hdr->bucket_cnt * sizeof(size_t);
+    if (hdr->data_off + sizeof(SME) >= size) {
+        return -1;
+    }
+    hdr->data_size = size - hdr->data_off;
+    hdr->tail = hdr->data_off;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&hdr->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    /* the other processes wait for the magic number */
+    atomic_store_explicit((atomic_uint *)&hdr->magic, SHM_CACHE_MAGIC,
+                          memory_order_release);
+    return 0;
+}
+
+/* shm_cache_open
+ * attaches to the region called name (such as "/proxy"), creating it
+ * with size bytes if it does not exist; a region that exists keeps the
+ * size it was created with, and outlives the processes using it
+ * returns NULL on error
+ */
+SC *shm_cache_open (char *name, size_t size) {
+    struct stat st;
+    SC *Shm;
+    char *base;
+    int fd, waited, created = 0;
+
+    if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL,
+                       S_IRUSR | S_IWUSR)) >= 0) {
+        created = 1;
+        if (ftruncate(fd, size) < 0) {
+            goto err_fd;
+        }
+        st.st_size = size;
+    }
+    else if (errno == EEXIST && (fd = shm_open(name, O_RDWR, 0)) >= 0) {
+        /* the process creating the region may not have sized it yet */
+        for (waited = 0; ; waited += 10) {
+            if (fstat(fd, &st) < 0) {
+                goto err_fd;
+            }
+            if (st.st_size >= sizeof(SMH) || waited >= SHM_CACHE_WAIT_MS) {
+                break;
+            }
+            usleep(10000);
+        }
+        if (st.st_size < sizeof(SMH)) {
+            goto err_fd;
+        }
+    }
+    else {
+        return NULL;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        goto err_fd;
+    }
+    close(fd);
+
+    SMH *hdr = (SMH *)base;
+    if (created) {
+        if (shm_cache_init(hdr, size) < 0) {
+            goto err_map;
+        }
+    }
+    else {
+        for (waited = 0; atomic_load_explicit((atomic_uint *)&hdr->magic,
+                                              memory_order_acquire)
+                         != SHM_CACHE_MAGIC; waited += 10) {
+            if (waited >= SHM_CACHE_WAIT_MS) {
+                goto err_map;
+            }
+            usleep(10000);
+        }
+        if (hdr->version != SHM_CACHE_VERSION ||
+                hdr->region_size != st.st_size) {
+            goto err_map;
+        }
+    }
+    Shm = Malloc(sizeof(SC));
+    Shm->base = base;
+    Shm->hdr = hdr;
+    Shm->buckets = (size_t *)(base + shm_cache_align(sizeof(SMH)));
+    if ((Shm->slot = shm_cache_attach(Shm)) < 0) {
+        Free(Shm);
+        goto err_map;
+    }
+    log_info("shm cache: %s attached (%lu bytes, %u entries)\n",
+             name, (unsigned long)hdr->region_size, hdr->entry_cnt);
+    return Shm;
+
+ err_map:
+    munmap(base, st.st_size);
+    fd = -1;
+ err_fd:
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (created) {
+        shm_unlink(name);
+    }
+    return NULL;
+}
+
+/* shm_cache_close
+ * gives up the slot of this process and unmaps the region, which
+ * stays for the other processes; no thread may be using it
+ */
+void shm_cache_close (SC *Shm) {
+    shm_cache_lock(Shm);
+    Shm->hdr->procs[Shm->slot] = 0;
+    shm_cache_unlock(Shm);
+    munmap(Shm->base, Shm->hdr->region_size);
+    Free(Shm);
+}
+
+/* shm_cache_get
+ * returns a block for the entry cached for key that suits a request
+ * with the headers req_hdrs, or NULL on a miss
+ * the block points into the region, and the entry is pinned until the
+ * block is handed back with shm_cache_release
+ */
+CB *shm_cache_get (SC *Shm, char *key, char *req_hdrs) {
+    CB *blk = NULL;
+    shm_cache_lock(Shm);
+    size_t off = shm_cache_lookup(Shm, key, req_hdrs);
+    if (off) {
+        SME *entry = shm_cache_entry(Shm, off);
+        entry->pins[Shm->slot]++;
+        blk = Malloc(sizeof(CB));
+        blk->id = shm_cache_id(entry);
+        blk->key_hash = entry->key_hash;
+        blk->vary = entry->vary_len ? shm_cache_vary(entry) : NULL;
+        blk->vary_hash = entry->vary_hash;
+        blk->data = shm_cache_data(entry);
+        blk->size = entry->size;
+        blk->prev = NULL;
+        blk->next = NULL;
+        blk->hnext = NULL;
+        blk->refcnt = 1;
+        blk->evicted = 0;
+        blk->mapped = 1;
+        blk->shm_off = off;
+        blk->expires = entry->expires;
+        blk->encoding = entry->encoding;
+        blk->hdr_size = entry->hdr_size;
+        blk->body_size = entry->body_size;
+        blk->raw_size = entry->raw_size;
+        blk->gzip_hdr_size = entry->gzip_hdr_size;
+    }
+    shm_cache_unlock(Shm);
+    return blk;
+}
+
+/* shm_cache_release
+ * unpins the entry of a block returned by shm_cache_get, and frees it
+ */
+void shm_cache_release (SC *Shm, CB *blk) {
+    shm_cache_lock(Shm);
+    SME *entry = shm_cache_entry(Shm, blk->shm_off);
+    if (entry->pins[Shm->slot]) {
+        entry->pins[Shm->slot]--;
+    }
+    shm_cache_unlock(Shm);
+    Free(blk);
+}
+
+/* shm_cache_check
+ * checks if key is cached for a request with headers req_hdrs
+ */
+int shm_cache_check (SC *Shm, char *key, char *req_hdrs) {
+    shm_cache_lock(Shm);
+    int cached = (shm_cache_lookup(Shm, key, req_hdrs) != 0);
+    shm_cache_unlock(Shm);
+    return cached;
+}
+
+/* shm_cache_same_vary
+ * checks if an entry and a block vary on the same headers
+ */
+static int shm_cache_same_vary (SME *entry, CB *blk) {
+    if (entry->vary_len == 0 || blk->vary == NULL) {
+        return entry->vary_len == 0 && blk->vary == NULL;
+    }
+    return !strcmp(shm_cache_vary(entry), blk->vary);
+}
+
+/* shm_cache_put
+ * copies a block into the region, replacing older entries of the same
+ * key as cache_add_block does
+ * the data is copied without the lock, into an entry that is reserved
+ * and pinned, and indexed afterwards
+ * returns 0 on success, -1 if the block was not stored
+ */
+int shm_cache_put (SC *Shm, CB *blk) {
+    SMH *hdr = Shm->hdr;
+    unsigned id_len = strlen(blk->id);
+    unsigned vary_len = blk->vary ? strlen(blk->vary) : 0;
+    size_t len = shm_cache_align(sizeof(SME) + id_len + 1 +
+                                 vary_len + 1 + blk->size);
+    if (len > hdr->data_size) {
+        return -1;
+    }
+    shm_cache_lock(Shm);
+    if (shm_cache_make_room(Shm, len) < 0) {
+        shm_cache_unlock(Shm);
+        return -1;
+    }
+    size_t off = hdr->tail;
+    SME *entry = shm_cache_entry(Shm, off);
+    entry->hnext = 0;
+    entry->lnext = 0;
+    entry->len = len;
+    entry->indexed = 0;
+    memset(entry->pins, 0, sizeof(entry->pins));
+    entry->key_hash = blk->key_hash;
+    entry->vary_hash = blk->vary_hash;
+    entry->expires = blk->expires;
+    entry->id_len = id_len;
+    entry->vary_len = vary_len;
+    entry->size = blk->size;
+    entry->encoding = blk->encoding;
+    entry->hdr_size = blk->hdr_size;
+    entry->body_size = blk->body_size;
+    entry->raw_size = blk->raw_size;
+    entry->gzip_hdr_size = blk->gzip_hdr_size;
+    memcpy(shm_cache_id(entry), blk->id, id_len + 1);
+    memcpy(shm_cache_vary(entry), blk->vary ? blk->vary : "", vary_len + 1);
+    entry->pins[Shm->slot] = 1;
+
+    /* the room is reserved, the entry joins the ring unindexed */
+    if (hdr->log_tail) {
+        shm_cache_entry(Shm, hdr->log_tail)->lnext = off;
+    }
+    else {
+        hdr->log_head = off;
+    }
+    hdr->log_tail = off;
+    hdr->tail = off + len;
+    shm_cache_unlock(Shm);
+
+    memcpy(shm_cache_data(entry), blk->data, blk->size);
+
+    shm_cache_lock(Shm);
+    entry->pins[Shm->slot]--;
+    /* replace the same variant, and variants on other headers */
+    size_t *bucket = shm_cache_bucket(Shm, blk->key_hash);
+    size_t old = *bucket;
+    while (old) {
+        SME *old_entry = shm_cache_entry(Shm, old);
+        size_t hnext = old_entry->hnext;
+        if (old_entry->key_hash == blk->key_hash &&
+                !strcmp(shm_cache_id(old_entry), blk->id) &&
+                (!shm_cache_same_vary(old_entry, blk) ||
+                 old_entry->vary_hash == blk->vary_hash)) {
+            shm_cache_unindex(Shm, old);    /* stays in the ring */
+        }
+        old = hnext;
+    }
+    entry->hnext = *bucket;
+    *bucket = off;
+    entry->indexed = 1;
+    hdr->cache_size += entry->size;
+    hdr->entry_cnt++;
+    shm_cache_unlock(Shm);
+    return 0;
+}
+
+/* shm_cache_stats
+ * reads the bytes and the number of entries indexed in the region
+ */
+void shm_cache_stats (SC *Shm, size_t *cache_size, unsigned *entry_cnt) {
+    shm_cache_lock(Shm);
+    *cache_size = Shm->hdr->cache_size;
+    *entry_cnt = Shm->hdr->entry_cnt;
+    shm_cache_unlock(Shm);
+}
@@ -0,0 +1,80 @@
+/* This header file contains the interfaces to the shared memory cache,
+ * which holds the memory cache of several proxy processes in one region
+ */
+#ifndef __SHM_CACHE_H__
+#define __SHM_CACHE_H__
+
+#include "csapp.h"
+
+#define SHM_CACHE_MAGIC 0x50585348 /* "PXSH" */
+#define SHM_CACHE_VERSION 2
+#define SHM_CACHE_PROCS 16      /* processes attached at once */
+#define SHM_CACHE_ALIGN 8       /* entries start on this boundary */
+#define SHM_CACHE_WAIT_MS 1000  /* for the process creating the region */
+
+struct cache_block;
+
+/* the region starts with this header, followed by the hash buckets and
+ * the ring of entries; all links are offsets from the start of the
+ * region, which every process maps at its own address, and 0 is none
+ */
+typedef struct shm_cache_header {
+    unsigned magic;             /* stored last, once the region is ready */
+    unsigned version;
+    size_t region_size;
+    size_t data_off;            /* the ring of entries */
+    size_t data_size;
+    unsigned long bucket_cnt;   /* a power of 2 */
+    pthread_mutex_t mutex;      /* process-shared and robust */
+    pid_t procs[SHM_CACHE_PROCS]; /* attached processes, 0 if free */
+    size_t tail;                /* where the next entry is appended */
+    size_t log_head;            /* oldest entry */
+    size_t log_tail;            /* newest entry */
+    size_t cache_size;          /* bytes of the indexed entries */
+    unsigned entry_cnt;         /* indexed entries */
+} SMH;
+
+/* an entry, followed by the id, the vary list (both NUL-terminated)
+ * and the data
+ */
+typedef struct shm_cache_entry {
+    size_t hnext;               /* next entry in the hash chain */
+    size_t lnext;               /* next (newer) entry in the ring */
+    unsigned len;               /* length of the whole entry */
+    int indexed;                /* not replaced nor dropped yet */
+    unsigned short pins[SHM_CACHE_PROCS]; /* readers, per process slot */
+    unsigned long key_hash;
+    unsigned long vary_hash;
+    long expires;               /* as in CB */
+    unsigned id_len;
+    unsigned vary_len;          /* 0 if the response has no Vary */
+    unsigned size;
+    unsigned encoding;          /* as in CB */
+    unsigned hdr_size;
+    unsigned body_size;
+    unsigned raw_size;
+    unsigned gzip_hdr_size;
+} SME;
+
+typedef struct shm_cache {
+    char *base;                 /* where the region is mapped */
+    SMH *hdr;
+    size_t *buckets;
+    int slot;                   /* this process in hdr->procs */
+} SC;
+
+SC *shm_cache_open (char *name, size_t size);
+
+void shm_cache_close (SC *Shm);
+
+struct cache_block *shm_cache_get (SC *Shm, char *key, char *req_hdrs);
+
+void shm_cache_release (SC *Shm, struct cache_block *blk);
+
+int shm_cache_check (SC *Shm, char *key, char *req_hdrs);
+
+int shm_cache_put (SC *Shm, struct cache_block *blk);
+
+void shm_cache_stats (SC *Shm, size_t *cache_size, unsigned *entry_cnt);
+
+#endif /* __SHM_CACHE_H__ */
@@ -0,0 +1,227 @@
+/* sim
+ * cache simulator: replays a trace through the real cache code
+ * (cache_get, cache_insert) without any socket, and reports the object
+ * and byte hit ratios for every capacity and policy of a sweep
+ * each sweep point gets a cache of its own, and the points are run by
+ * a pool of threads
+ *
+ * a miss inserts a response of the traced size, with a small header,
+ * exactly as doit would; objects bigger than the object limit are
+ * never cached
+ *
+ * usage: proxy-sim [-c sizes] [-e policies] [-o objectsize] [-t threads]
+ *            [-r trace | -n requests -u objects -s zipf -m mix -S seed]
+ * e.g. proxy-sim -c 1M,4M,16M -e lru,fifo -r access.trace
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include <stdatomic.h>
+#include "csapp.h"
+#include "cache.h"
+#include "trace.h"
+
+#define SIM_SIZES "256K,1M,4M,16M,64M"
+#define SIM_POLICIES "lru,fifo"
+#define SIM_MAX_POINTS 256
+
+/* a point of the sweep, and its results */
+typedef struct sim_point {
+    size_t capacity;
+    int policy;
+    unsigned long hits;
+    unsigned long bytes;
+    unsigned long hit_bytes;
+    double seconds;
+} SP;
+
+static TR *trace;
+static size_t object_size = MAX_OBJECT_SIZE;
+static SP points[SIM_MAX_POINTS];
+static unsigned point_cnt;
+static atomic_uint next_point;
+
+//=========================================functions
+/* sim_run
+ * replays the trace into a fresh cache for one sweep point
+ */
+static void sim_run (SP *point) {
+    char hdr[MAXLINE];
+    char *response = Malloc(object_size);
+    struct timespec start, end;
+    unsigned i;
+
+    CM *Cache = cache_create_new_cache(point->capacity, object_size);
+    Cache->policy = point->policy;
+    memset(response, 'x', object_size);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < trace->cnt; i++) {
+        char *key = trace->uri[i];
+        unsigned size = trace->size[i];
+        CB *blk = cache_get(Cache, key, "");
+        point->bytes += size;
+        if (blk) {
+            point->hits++;
+            point->hit_bytes += size;
+            cache_release(Cache, blk);
+            continue;
+        }
+        int hdr_size = sprintf(hdr, "HTTP/1.0 200 OK\r\n"
+                "Content-Length: %u\r\n\r\n", size);
+        if (hdr_size + size <= object_size) {
+            memcpy(response, hdr, hdr_size);
+            cache_insert(Cache, key, "", response, hdr_size + size);
+            memset(response, 'x', hdr_size);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    point->seconds = (end.tv_sec - start.tv_sec) +
+                     (end.tv_nsec - start.tv_nsec) / 1e9;
+    cache_destroy(Cache);
+    Free(response);
+}
+
+/* sim_thread
+ * runs the next sweep point until there is none left
+ */
+static void *sim_thread (void *vargp) {
+    unsigned i;
+    while ((i = atomic_fetch_add(&next_point, 1)) < point_cnt) {
+        sim_run(&points[i]);
+    }
+    return NULL;
+}
+
+/* sim_format_size
+ * prints a size with the largest unit that divides it
+ */
+static char *sim_format_size (size_t size, char *buf) {
+    const char *units = "BKMG";
+    int u = 0;
+    while (u < 3 && size >= 1024 && size % 1024 == 0) {
+        size /= 1024;
+        u++;
+    }
+    sprintf(buf, "%zu%c", size, units[u]);
+    return buf;
+}
+
+static void usage (char *prog) {
+    fprintf(stderr, "usage: %s [-c sizes] [-e policies] [-o objectsize] "
+            "[-t threads] [-r trace | -n requests -u objects -s zipf "
+            "-m mix -S seed]\n", prog);
+    exit(1);
+}
+
+int main (int argc, char **argv) {
+    char *sizes = SIM_SIZES, *policies = SIM_POLICIES, *trace_in = NULL;
+    char *mix = TRACE_MIX, *ptr, *save, buf[32];
+    unsigned requests = TRACE_REQUESTS, objects = TRACE_OBJECTS;
+    unsigned seed = 1, i;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    double zipf = TRACE_ZIPF;
+    pthread_t *tids;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:e:o:t:r:n:u:s:m:S:")) != -1) {
+        switch (opt) {
+        case 'c':
+            sizes = optarg;
+            break;
+        case 'e':
+            policies = optarg;
+            break;
+        case 'o':
+            if ((object_size = cache_parse_size(optarg)) == 0 ||
+                    object_size > CACHE_OBJECT_LIMIT) {
+                usage(argv[0]);
+            }
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'r':
+            trace_in = optarg;
+            break;
+        case 'n':
+            requests = atoi(optarg);
+            break;
+        case 'u':
+            objects = atoi(optarg);
+            break;
+        case 's':
+            zipf = atof(optarg);
+            break;
+        case 'm':
+            mix = optarg;
+            break;
+        case 'S':
+            seed = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    /* the sweep: every policy at every size */
+    policies = strdup(policies);
+    for (ptr = strtok_r(policies, ",", &save); ptr;
+         ptr = strtok_r(NULL, ",", &save)) {
+        int policy = cache_parse_policy(ptr);
+        char *size_list = strdup(sizes), *size_str, *size_save;
+        if (policy < 0) {
+            fprintf(stderr, "Error: unknown policy %s\n", ptr);
+            exit(1);
+        }
+        for (size_str = strtok_r(size_list, ",", &size_save); size_str;
+             size_str = strtok_r(NULL, ",", &size_save)) {
+            if (point_cnt == SIM_MAX_POINTS) {
+                break;
+            }
+            points[point_cnt].capacity = cache_parse_size(size_str);
+            points[point_cnt].policy = policy;
+            if (points[point_cnt].capacity == 0) {
+                usage(argv[0]);
+            }
+            point_cnt++;
+        }
+        free(size_list);
+    }
+    free(policies);
+
+    trace = trace_in ? trace_load(trace_in)
+                     : trace_zipf(requests, objects, zipf, mix, seed);
+    if (trace == NULL) {
+        fprintf(stderr, "Error: cannot %s trace\n",
+                trace_in ? "read the" : "generate the");
+        exit(1);
+    }
+
+    tids = Malloc(threads * sizeof(pthread_t));
+    for (i = 0; i < threads; i++) {
+        Pthread_create(&tids[i], NULL, sim_thread, NULL);
+    }
+    for (i = 0; i < threads; i++) {
+        Pthread_join(tids[i], NULL);
+    }
+    Free(tids);
+
+    printf("%u requests, object limit %s\n", trace->cnt,
+           sim_format_size(object_size, buf));
+    printf("%-6s %10s %10s %10s %10s\n", "policy", "capacity",
+           "obj hit", "byte hit", "seconds");
+    for (i = 0; i < point_cnt; i++) {
+        SP *p = &points[i];
+        printf("%-6s %10s %10.4f %10.4f %10.2f\n",
+               cache_policy_name(p->policy), sim_format_size(p->capacity, buf),
+               trace->cnt ? (double)p->hits / trace->cnt : 0.0,
+               p->bytes ? (double)p->hit_bytes / p->bytes : 0.0, p->seconds);
+    }
+    trace_free(trace);
+    return 0;
+}
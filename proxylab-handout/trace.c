@@ -0,0 +1,206 @@
+/* trace
+ * request traces for the benchmark (bench.c) and the cache simulator
+ * (sim.c): either read from a file, one "<uri> <size>" request per
+ * line, or generated with Zipf-distributed popularity over a fixed set
+ * of objects whose sizes follow a weighted mix
+ */
+
+/* Name = Hailei Yu
+ * Andrew ID = haileiy
+ */
+
+#include <math.h>
+#include "csapp.h"
+#include "trace.h"
+
+//=========================================functions
+/* trace_alloc
+ * returns an empty trace with room for cnt requests
+ */
+static TR *trace_alloc (unsigned cnt) {
+    TR *trace = Malloc(sizeof(TR));
+    trace->cnt = 0;
+    trace->uri = Malloc((cnt ? cnt : 1) * sizeof(char *));
+    trace->size = Malloc((cnt ? cnt : 1) * sizeof(unsigned));
+    trace->strings = NULL;
+    return trace;
+}
+
+/* trace_load
+ * reads a trace file; lines that are not "<uri> <size>" are skipped
+ * returns NULL if the file cannot be read
+ */
+TR *trace_load (char *path) {
+    struct stat st;
+    unsigned lines = 0;
+    char *ptr, *end;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+    char *strings = Malloc(st.st_size + 1);
+    if (rio_readn(fd, strings, st.st_size) != st.st_size) {
+        close(fd);
+        Free(strings);
+        return NULL;
+    }
+    close(fd);
+    strings[st.st_size] = '\0';
+    for (ptr = strings; *ptr; ptr++) {
+        lines += (*ptr == '\n');
+    }
+
+    TR *trace = trace_alloc(lines + 1);
+    trace->strings = strings;
+    for (ptr = strings; *ptr; ptr = end) {
+        char *uri, *size_str, *save;
+        end = strchr(ptr, '\n');
+        end = end ? end + 1 : ptr + strlen(ptr);
+        if (end > ptr && end[-1] == '\n') {
+            end[-1] = '\0';
+        }
+        uri = strtok_r(ptr, " \t\r", &save);
+        size_str = uri ? strtok_r(NULL, " \t\r", &save) : NULL;
+        if (size_str == NULL || atol(size_str) <= 0) {
+            continue;
+        }
+        trace->uri[trace->cnt] = uri;
+        trace->size[trace->cnt] = atol(size_str);
+        trace->cnt++;
+    }
+    return trace;
+}
+
+/* trace_rand
+ * xorshift64*, returns a double in [0, 1)
+ */
+static double trace_rand (unsigned long *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return ((*state * 2685821657736338717UL) >> 11) / 9007199254740992.0;
+}
+
+/* trace_parse_mix
+ * parses a size mix such as "60:2K,30:16K,10:1M"
+ * returns the number of classes, 0 if the mix is invalid
+ */
+static int trace_parse_mix (char *mix, double *weight, unsigned *size,
+                            int max) {
+    int cnt = 0;
+    char *ptr = mix;
+    while (*ptr && cnt < max) {
+        char *end;
+        weight[cnt] = strtod(ptr, &end);
+        if (*end != ':' || weight[cnt] <= 0) {
+            return 0;
+        }
+        size[cnt] = strtoul(end + 1, &end, 10);
+        if (*end == 'K' || *end == 'k') {
+            size[cnt] <<= 10;
+            end++;
+        }
+        else if (*end == 'M' || *end == 'm') {
+            size[cnt] <<= 20;
+            end++;
+        }
+        if (size[cnt] == 0 || (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        cnt++;
+        ptr = (*end == ',') ? end + 1 : end;
+    }
+    return cnt;
+}
+
+/* trace_zipf
+ * generates requests over objects "/obj/<i>", where object i is
+ * requested with probability proportional to 1 / i^s; the size of
+ * each object is drawn from mix
+ * returns NULL if mix is invalid
+ */
+TR *trace_zipf (unsigned requests, unsigned objects, double s,
+                char *mix, unsigned seed) {
+    double weight[16], total = 0, *cdf;
+    unsigned class_size[16], *obj_size, i;
+    unsigned long state = 0x9e3779b97f4a7c15UL ^ seed;
+    int classes = trace_parse_mix(mix, weight, class_size, 16), c;
+
+    if (classes == 0 || objects == 0) {
+        return NULL;
+    }
+    for (c = 0; c < classes; c++) {
+        total += weight[c];
+    }
+
+    /* name and size every object */
+    TR *trace = trace_alloc(requests);
+    trace->strings = Malloc(objects * 16);
+    char **names = Malloc(objects * sizeof(char *));
+    obj_size = Malloc(objects * sizeof(unsigned));
+    cdf = Malloc(objects * sizeof(double));
+    double sum = 0;
+    for (i = 0; i < objects; i++) {
+        double pick = trace_rand(&state) * total;
+        for (c = 0; c < classes - 1 && pick >= weight[c]; c++) {
+            pick -= weight[c];
+        }
+        names[i] = trace->strings + i * 16;
+        snprintf(names[i], 16, "/obj/%u", i);
+        obj_size[i] = class_size[c];
+        sum += 1.0 / pow(i + 1, s);
+        cdf[i] = sum;
+    }
+
+    /* draw the requests */
+    for (i = 0; i < requests; i++) {
+        double pick = trace_rand(&state) * sum;
+        unsigned lo = 0, hi = objects - 1;
+        while (lo < hi) {
+            unsigned mid = (lo + hi) / 2;
+            if (cdf[mid] <= pick) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        trace->uri[i] = names[lo];
+        trace->size[i] = obj_size[lo];
+    }
+    trace->cnt = requests;
+    Free(names);
+    Free(obj_size);
+    Free(cdf);
+    return trace;
+}
+
+/* trace_save
+ * writes a trace file that trace_load reads back
+ * returns 0 on success, -1 on error
+ */
+int trace_save (TR *trace, char *path) {
+    FILE *fp = fopen(path, "w");
+    unsigned i;
+    if (fp == NULL) {
+        return -1;
+    }
+    for (i = 0; i < trace->cnt; i++) {
+        fprintf(fp, "%s %u\n", trace->uri[i], trace->size[i]);
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+void trace_free (TR *trace) {
+    Free(trace->uri);
+    Free(trace->size);
+    if (trace->strings) {
+        Free(trace->strings);
+    }
+    Free(trace);
+}
@@ -0,0 +1,34 @@
+/* This header file contains the interfaces to request traces,
+ * shared by the benchmark and the cache simulator
+ */
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "csapp.h"
+
+/* default synthetic workload */
+#define TRACE_OBJECTS 10000
+#define TRACE_REQUESTS 100000
+#define TRACE_ZIPF 0.9
+#define TRACE_MIX "60:2K,30:16K,9:64K,1:512K"   /* weight:size,... */
+
+/* a trace is a list of requests for (uri, size) objects
+ * a trace file has one request per line: "<uri> <size>"
+ */
+typedef struct trace {
+    unsigned cnt;
+    char **uri;                 /* point into strings */
+    unsigned *size;
+    char *strings;
+} TR;
+
+TR *trace_load (char *path);
+
+TR *trace_zipf (unsigned requests, unsigned objects, double s,
+                char *mix, unsigned seed);
+
+int trace_save (TR *trace, char *path);
+
+void trace_free (TR *trace);
+
+#endif /* __TRACE_H__ */